@@ -0,0 +1,109 @@
+/*  binary checkpoint files, see checkpoint.h */
+
+#include <stdio.h>
+#include <string.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+#define CHECKPOINT_MAGIC 0x4b434757 // "WGCK"
+
+struct checkpoint_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t len;
+    uint32_t crc;
+};
+
+// plain bitwise crc32 (IEEE), checkpoints are small and written rarely
+static uint32_t crc32(const uint8_t *p, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+    while (len--)
+    {
+        crc ^= *p++;
+        for (uint8_t k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+            return 1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// write data to path atomically
+int checkpoint_write(const char *path, uint32_t version, const void *data, size_t len)
+{
+    char tmp[256], dir[256];
+    struct checkpoint_header hdr = {
+        .magic = CHECKPOINT_MAGIC,
+        .version = version,
+        .len = len,
+        .crc = crc32(data, len),
+    };
+
+    snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        perror(tmp);
+        return 1;
+    }
+    if (write_all(fd, &hdr, sizeof hdr) || write_all(fd, data, len) || fsync(fd))
+    {
+        perror(tmp);
+        close(fd);
+        unlink(tmp);
+        return 1;
+    }
+    close(fd);
+
+    if (rename(tmp, path))
+    {
+        perror("rename");
+        unlink(tmp);
+        return 1;
+    }
+
+    // make the rename itself durable
+    strncpy(dir, path, sizeof dir - 1);
+    dir[sizeof dir - 1] = '\0';
+    fd = open(dirname(dir), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+    return 0;
+}
+
+// read exactly len bytes of data from path
+int checkpoint_read(const char *path, uint32_t version, void *data, size_t len)
+{
+    struct checkpoint_header hdr;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 1;
+
+    int bad = read(fd, &hdr, sizeof hdr) != sizeof hdr ||
+              hdr.magic != CHECKPOINT_MAGIC || hdr.version != version ||
+              hdr.len != len || read(fd, data, len) != (ssize_t)len ||
+              hdr.crc != crc32(data, len);
+    close(fd);
+    if (bad)
+        fprintf(stderr, "%s: ignoring invalid checkpoint\n", path);
+    return bad;
+}
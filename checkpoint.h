@@ -0,0 +1,21 @@
+/*  binary checkpoint files
+ *
+ *  a checkpoint is a blob of program state behind a small header with a
+ *  magic, version, length and crc32. it gets written to a temporary file
+ *  and renamed over the old one, so readers see either the old or the new
+ *  checkpoint, never a half written one.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// write data to path atomically
+int checkpoint_write(const char *path, uint32_t version, const void *data, size_t len);
+// read exactly len bytes of data from path
+// fails if the file is missing, corrupt or has a different version or length
+int checkpoint_read(const char *path, uint32_t version, void *data, size_t len);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,97 @@
+/*  hardware scrolled text console, see console.h */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "ili9341_spi.h"
+#include "glcdfont.h"
+#include "console.h"
+
+struct text_line {
+    const struct console *c;
+    char text[ILI9341_TFTHEIGHT / 6 + 1];
+};
+
+// column col of a rotated text line: GRAM line col of the text line, its
+// pixels run right to left when read in portrait
+static void text_column(uint16_t col, uint16_t *line, uint16_t height, void *arg)
+{
+    const struct text_line *tl = arg;
+    const struct console *c = tl->c;
+    uint8_t row = col / c->size;    // glyph row
+
+    for (uint16_t j = 0; j < height; j++)
+    {
+        uint16_t u = height - 1 - j;    // position from the left in portrait
+        uint16_t ch = u / (6 * c->size);
+        uint8_t gx = u % (6 * c->size) / c->size;
+        unsigned char chr = tl->text[ch];
+        // Handle 'classic' charset behavior like drawChar()
+        if (chr >= 176)
+            chr++;
+        line[j] = chr && gx < 5 && row < 8 && (font[chr * 5 + gx] >> row & 1) ?
+                  c->fg : c->bg;
+    }
+}
+
+// render text into the text line starting at GRAM line x, one window
+static void draw_line(const struct console *c, uint16_t x, const char *text)
+{
+    struct text_line tl = { .c = c };
+    size_t len = strcspn(text, "\n");
+
+    if (len > c->cols)
+        len = c->cols;
+    memset(tl.text, 0, sizeof tl.text);
+    memcpy(tl.text, text, len);
+    drawColumns(x, 0, c->line_h, ILI9341_TFTHEIGHT, text_column, &tl);
+}
+
+void console_init(struct console *c, uint8_t header, uint8_t footer,
+                  uint8_t size, uint16_t fg, uint16_t bg)
+{
+    c->size = size ? size : 1;
+    c->fg = fg;
+    c->bg = bg;
+    c->line_h = 8 * c->size;
+    c->cols = ILI9341_TFTHEIGHT / (6 * c->size);
+    c->header = header;
+    c->footer = footer;
+    c->top = header * c->line_h;
+    c->lines = (ILI9341_TFTWIDTH - (header + footer) * c->line_h) / c->line_h;
+    c->next = 0;
+    c->full = 0;
+
+    fillRect(0, 0, ILI9341_TFTWIDTH, ILI9341_TFTHEIGHT, bg);
+    // the scroll area has to be a whole number of text lines so it wraps
+    // cleanly, what is left over becomes part of the bottom margin
+    setScrollMargins(c->top, ILI9341_TFTWIDTH - c->top - c->lines * c->line_h);
+    scrollTo(c->top);
+}
+
+void console_print(struct console *c, const char *text)
+{
+    if (!c->lines)
+        return;
+    draw_line(c, c->top + c->next * c->line_h, text);
+    if (++c->next == c->lines)
+    {
+        c->next = 0;
+        c->full = 1;
+    }
+    // once full, the oldest line (the one overwritten next) goes on top
+    if (c->full)
+        scrollTo(c->top + c->next * c->line_h);
+}
+
+void console_header(struct console *c, uint8_t n, const char *text)
+{
+    if (n < c->header)
+        draw_line(c, n * c->line_h, text);
+}
+
+void console_footer(struct console *c, uint8_t n, const char *text)
+{
+    if (n < c->footer)
+        draw_line(c, c->top + (c->lines + n) * c->line_h, text);
+}
@@ -0,0 +1,44 @@
+/*  hardware scrolled text console
+ *
+ *  the ILI9341 scrolls along the GRAM page address, which is x in this
+ *  driver, so the console is read in portrait: turn the display clockwise
+ *  by 90 degrees and x runs top to bottom, lines are 240 pixels wide.
+ *  text is drawn rotated accordingly.
+ *
+ *  a new line is rendered once into the next line of the scroll area and
+ *  the scroll start (VSCRSADD) is moved on, so printing costs one line of
+ *  pixels plus a 2 byte scroll command, nothing already on screen gets
+ *  redrawn. optional header and footer lines stay fixed outside of the
+ *  scroll area.
+ *
+ *  chip select has to be handled by the caller.
+ */
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+
+struct console {
+    uint8_t size;       // text size
+    uint16_t fg, bg;
+    uint16_t line_h;    // pixels (GRAM lines) per text line
+    uint16_t cols;      // characters per line
+    uint16_t top;       // first GRAM line of the scroll area
+    uint16_t header, footer; // text lines above/below the scroll area
+    uint16_t lines;     // text lines in the scroll area
+    uint16_t next;      // scroll area line the next text goes into
+    uint8_t full;       // all lines used, scrolling from now on
+};
+
+// clear the display and set up header and footer lines (may be 0)
+void console_init(struct console *c, uint8_t header, uint8_t footer,
+                  uint8_t size, uint16_t fg, uint16_t bg);
+// add a line at the bottom, scrolls once the console is full
+// longer lines get cut, a trailing '\n' is ignored
+void console_print(struct console *c, const char *text);
+// replace fixed line n of the header/footer
+void console_header(struct console *c, uint8_t n, const char *text);
+void console_footer(struct console *c, uint8_t n, const char *text);
+
+#endif // CONSOLE_H
@@ -0,0 +1,111 @@
+/*  client side of the display_server protocol, see display_client.h */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "display_client.h"
+
+// connect to the server and map the framebuffer of panel
+int display_connect(struct display_client *dc, uint8_t panel)
+{
+    memset(dc, 0, sizeof *dc);
+    dc->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (dc->sock < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, DISPLAY_SOCKET, sizeof addr.sun_path - 1);
+    if (connect(dc->sock, (struct sockaddr*) &addr, sizeof addr) < 0)
+    {
+        perror("connect");
+        close(dc->sock);
+        return 1;
+    }
+
+    struct display_msg msg = { .type = DISPLAY_MSG_ATTACH, .panel = panel };
+    if (send(dc->sock, &msg, sizeof msg, 0) < 0)
+    {
+        perror("send");
+        close(dc->sock);
+        return 1;
+    }
+
+    // answer carries the memfd of the framebuffer as ancillary data
+    char cbuf[CMSG_SPACE(sizeof (int))];
+    struct iovec iov = { .iov_base = &msg, .iov_len = sizeof msg };
+    struct msghdr mh = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = cbuf, .msg_controllen = sizeof cbuf,
+    };
+    struct cmsghdr *cmsg;
+    if (recvmsg(dc->sock, &mh, MSG_CMSG_CLOEXEC) <= 0 || msg.type != DISPLAY_MSG_FB ||
+        !(cmsg = CMSG_FIRSTHDR(&mh)) || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        fprintf(stderr, "display server refused panel %u\n", panel);
+        close(dc->sock);
+        return 1;
+    }
+    int fd_fb;
+    memcpy(&fd_fb, CMSG_DATA(cmsg), sizeof fd_fb);
+
+    size_t len = (size_t)msg.fb.stride * msg.fb.height * 2;
+    dc->fb = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd_fb, 0);
+    close(fd_fb);
+    if (dc->fb == MAP_FAILED)
+    {
+        perror("mmap");
+        close(dc->sock);
+        return 1;
+    }
+    dc->panel = panel;
+    dc->width = msg.fb.width;
+    dc->height = msg.fb.height;
+    dc->stride = msg.fb.stride;
+    dc->pending.type = DISPLAY_MSG_DAMAGE;
+    dc->pending.panel = panel;
+    return 0;
+}
+
+// mark an area of the framebuffer as changed
+// the server merges overlapping rects, so no need to be clever here
+void display_damage(struct display_client *dc, uint16_t x, uint16_t y,
+                    uint16_t w, uint16_t h)
+{
+    if (x >= dc->width || y >= dc->height || !w || !h)
+        return;
+    if (x + w > dc->width) w = dc->width - x;
+    if (y + h > dc->height) h = dc->height - y;
+
+    if (dc->pending.n_rects == DISPLAY_MAX_RECTS)
+        display_flush(dc);
+    dc->pending.rects[dc->pending.n_rects++] = (struct display_rect) { x, y, w, h };
+}
+
+// send the collected damage to the server
+int display_flush(struct display_client *dc)
+{
+    if (!dc->pending.n_rects)
+        return 0;
+    if (send(dc->sock, &dc->pending, sizeof dc->pending, 0) < 0)
+    {
+        perror("send");
+        return 1;
+    }
+    dc->pending.n_rects = 0;
+    return 0;
+}
+
+// unmap framebuffer and close the connection
+void display_disconnect(struct display_client *dc)
+{
+    display_flush(dc);
+    munmap(dc->fb, (size_t)dc->stride * dc->height * 2);
+    close(dc->sock);
+}
@@ -0,0 +1,36 @@
+/*  client side of the display_server protocol
+ *
+ *  usage:
+ *      struct display_client dc;
+ *      display_connect(&dc, 0);
+ *      dc.fb[y * dc.stride + x] = ILI9341_RED;
+ *      display_damage(&dc, x, y, 1, 1);
+ *      display_flush(&dc);
+ */
+
+#ifndef DISPLAY_CLIENT_H
+#define DISPLAY_CLIENT_H
+
+#include <stdint.h>
+#include "display_proto.h"
+
+struct display_client {
+    int sock;
+    uint8_t panel;
+    uint16_t *fb;               // shared framebuffer of the panel
+    uint16_t width, height;
+    uint16_t stride;            // in pixels
+    struct display_msg pending; // damage collected until display_flush()
+};
+
+// connect to the server and map the framebuffer of panel
+int display_connect(struct display_client *dc, uint8_t panel);
+// mark an area of the framebuffer as changed
+void display_damage(struct display_client *dc, uint16_t x, uint16_t y,
+                    uint16_t w, uint16_t h);
+// send the collected damage to the server
+int display_flush(struct display_client *dc);
+// unmap framebuffer and close the connection
+void display_disconnect(struct display_client *dc);
+
+#endif // DISPLAY_CLIENT_H
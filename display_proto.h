@@ -0,0 +1,48 @@
+/*  protocol between display_server and its clients
+ *
+ *  the server owns spidev and the GPIOs and keeps one shared framebuffer
+ *  per panel. clients connect over a SOCK_SEQPACKET unix socket, ask for
+ *  a panel with DISPLAY_MSG_ATTACH and get the memfd of its framebuffer
+ *  back (SCM_RIGHTS). they draw into the mapping directly and tell the
+ *  server which areas changed with DISPLAY_MSG_DAMAGE.
+ */
+
+#ifndef DISPLAY_PROTO_H
+#define DISPLAY_PROTO_H
+
+#include <stdint.h>
+
+// the directory is created mode 0700, only processes running as the same
+// user as display_server can connect and draw on the panels
+#define DISPLAY_SOCKET_DIR "/tmp/ili9341_display"
+#define DISPLAY_SOCKET DISPLAY_SOCKET_DIR "/display.sock"
+#define DISPLAY_PANELS 2        // one per chip select line
+#define DISPLAY_MAX_RECTS 32    // damage rectangles per message
+
+enum display_msg_type {
+    DISPLAY_MSG_ATTACH = 1,     // client -> server: map framebuffer of panel
+    DISPLAY_MSG_DAMAGE,         // client -> server: rects changed in framebuffer
+    DISPLAY_MSG_FB,             // server -> client: framebuffer info + memfd
+};
+
+struct display_rect {
+    uint16_t x, y, w, h;
+};
+
+// framebuffer pixels are native RGB565, row-major, stride in pixels
+struct display_fb_info {
+    uint16_t width, height;
+    uint16_t stride;
+};
+
+struct display_msg {
+    uint8_t type;               // enum display_msg_type
+    uint8_t panel;
+    uint16_t n_rects;
+    union {
+        struct display_rect rects[DISPLAY_MAX_RECTS];
+        struct display_fb_info fb;
+    };
+};
+
+#endif // DISPLAY_PROTO_H
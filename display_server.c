@@ -0,0 +1,348 @@
+/*  display server: owns spidev, the GPIOs and both displays
+ *
+ *  usage: display_server <spidev>
+ *
+ *  every panel gets a memfd backed RGB565 framebuffer that clients map and
+ *  draw into directly (see display_client.h). clients post damage rects,
+ *  the server merges the damage of all clients per panel and flushes it
+ *  once per poll round, so several programs can share the displays without
+ *  fighting over the bus.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <bcm2835.h>
+#include "ili9341_spi.h"
+#include "display_proto.h"
+
+#define MAX_CLIENTS 16
+#define MAX_DAMAGE 16    // merged damage rects kept per panel
+// merge two rects if the union covers at most this many pixels more than
+// both of them, roughly what the window setup for a second rect costs
+#define DAMAGE_SLACK 64
+
+static uint8_t dc_pin = RPI_V2_GPIO_P1_22;
+static uint8_t rst_pin = RPI_V2_GPIO_P1_18;
+
+struct panel {
+    uint8_t cs_pin;
+    int fd_fb;              // memfd handed out to clients
+    uint16_t *fb;
+    struct display_rect damage[MAX_DAMAGE];
+    uint8_t n_damage;
+};
+static struct panel panels[DISPLAY_PANELS] = {
+    { .cs_pin = RPI_V2_GPIO_P1_13 },
+    { .cs_pin = RPI_V2_GPIO_P1_16 },
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static uint32_t rect_area(struct display_rect r)
+{
+    return (uint32_t)r.w * r.h;
+}
+
+static struct display_rect rect_union(struct display_rect a, struct display_rect b)
+{
+    uint16_t x1 = a.x < b.x ? a.x : b.x;
+    uint16_t y1 = a.y < b.y ? a.y : b.y;
+    uint16_t x2 = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;
+    uint16_t y2 = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;
+    return (struct display_rect) { x1, y1, x2 - x1, y2 - y1 };
+}
+
+/* add r to the damage of a panel
+ * r absorbs every rect it can be merged with cheaply, merging may enable
+ * further merges so start over after each one. if the list is full r gets
+ * merged into the rect where that adds the least pixels
+ */
+static void damage_add(struct panel *p, struct display_rect r)
+{
+    if (r.x >= ILI9341_TFTWIDTH || r.y >= ILI9341_TFTHEIGHT || !r.w || !r.h)
+        return;
+    if (r.x + r.w > ILI9341_TFTWIDTH) r.w = ILI9341_TFTWIDTH - r.x;
+    if (r.y + r.h > ILI9341_TFTHEIGHT) r.h = ILI9341_TFTHEIGHT - r.y;
+
+    uint8_t merged;
+    do {
+        merged = 0;
+        for (uint8_t i = 0; i < p->n_damage; i++)
+        {
+            struct display_rect u = rect_union(p->damage[i], r);
+            if (rect_area(u) <= rect_area(p->damage[i]) + rect_area(r) + DAMAGE_SLACK)
+            {
+                r = u;
+                p->damage[i] = p->damage[--p->n_damage];
+                merged = 1;
+                break;
+            }
+        }
+    } while (merged);
+
+    if (p->n_damage == MAX_DAMAGE)
+    {
+        uint8_t best = 0;
+        uint32_t best_cost = -1;
+        for (uint8_t i = 0; i < p->n_damage; i++)
+        {
+            uint32_t cost = rect_area(rect_union(p->damage[i], r)) - rect_area(p->damage[i]);
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best = i;
+            }
+        }
+        r = rect_union(p->damage[best], r);
+        p->damage[best] = p->damage[--p->n_damage];
+        damage_add(p, r);
+        return;
+    }
+    p->damage[p->n_damage++] = r;
+}
+
+// send the damaged areas of every panel
+static void flush_panels()
+{
+    for (uint8_t i = 0; i < DISPLAY_PANELS; i++)
+    {
+        struct panel *p = &panels[i];
+        if (!p->n_damage)
+            continue;
+        bcm2835_gpio_write(p->cs_pin, LOW);
+        for (uint8_t k = 0; k < p->n_damage; k++)
+        {
+            struct display_rect r = p->damage[k];
+            drawRGBBitmap(r.x, r.y, r.w, r.h,
+                          p->fb + (uint32_t)r.y * ILI9341_TFTWIDTH + r.x, ILI9341_TFTWIDTH);
+        }
+        bcm2835_gpio_write(p->cs_pin, HIGH);
+        p->n_damage = 0;
+    }
+}
+
+static int init_panel(struct panel *p, uint8_t index)
+{
+    char name[16];
+    size_t len = (size_t)ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT * 2;
+
+    sprintf(name, "ili9341-fb%u", index);
+    p->fd_fb = memfd_create(name, MFD_CLOEXEC);
+    if (p->fd_fb < 0 || ftruncate(p->fd_fb, len) < 0)
+    {
+        perror("memfd");
+        return 1;
+    }
+    p->fb = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, p->fd_fb, 0);
+    if (p->fb == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    // memfd starts out zeroed == ILI9341_BLACK, push that to the panel
+    damage_add(p, (struct display_rect) { 0, 0, ILI9341_TFTWIDTH, ILI9341_TFTHEIGHT });
+    return 0;
+}
+
+static void init_displays()
+{
+    // both displays share the reset line, bring them up together
+    ili9341_reset();
+    for (uint8_t i = 0; i < DISPLAY_PANELS; i++)
+        bcm2835_gpio_write(panels[i].cs_pin, LOW);
+    begin();
+    for (uint8_t i = 0; i < DISPLAY_PANELS; i++)
+        bcm2835_gpio_write(panels[i].cs_pin, HIGH);
+}
+
+static int init_socket()
+{
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    // clients get both framebuffers, keep everybody else out. someone may
+    // have created the directory before us, check
+    struct stat st;
+    if (mkdir(DISPLAY_SOCKET_DIR, 0700) < 0 && errno != EEXIST)
+    {
+        perror(DISPLAY_SOCKET_DIR);
+        close(sock);
+        return -1;
+    }
+    if (lstat(DISPLAY_SOCKET_DIR, &st) < 0 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != getuid() || (st.st_mode & 077))
+    {
+        fprintf(stderr, "%s is not a private directory of ours\n", DISPLAY_SOCKET_DIR);
+        close(sock);
+        return -1;
+    }
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, DISPLAY_SOCKET, sizeof addr.sun_path - 1);
+    unlink(DISPLAY_SOCKET);
+    if (bind(sock, (struct sockaddr*) &addr, sizeof addr) < 0 || listen(sock, 4) < 0)
+    {
+        perror("bind");
+        close(sock);
+        return -1;
+    }
+    chmod(DISPLAY_SOCKET, 0600);
+    return sock;
+}
+
+// hand out the framebuffer of the requested panel
+static int send_fb(int sock, uint8_t panel)
+{
+    struct display_msg msg = {
+        .type = DISPLAY_MSG_FB,
+        .panel = panel,
+        .fb = { ILI9341_TFTWIDTH, ILI9341_TFTHEIGHT, ILI9341_TFTWIDTH },
+    };
+    char cbuf[CMSG_SPACE(sizeof (int))];
+    struct iovec iov = { .iov_base = &msg, .iov_len = sizeof msg };
+    struct msghdr mh = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = cbuf, .msg_controllen = sizeof cbuf,
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof (int));
+    memcpy(CMSG_DATA(cmsg), &panels[panel].fd_fb, sizeof (int));
+    return sendmsg(sock, &mh, MSG_NOSIGNAL) < 0;
+}
+
+// handle one message of a client, returns non-zero if it should be dropped
+static int handle_client(int sock)
+{
+    struct display_msg msg;
+    ssize_t len = recv(sock, &msg, sizeof msg, 0);
+    // everything past what the client sent is garbage from the stack
+    if (len < (ssize_t)offsetof(struct display_msg, rects) || msg.panel >= DISPLAY_PANELS)
+        return 1;
+
+    switch (msg.type)
+    {
+    case DISPLAY_MSG_ATTACH:
+        return send_fb(sock, msg.panel);
+    case DISPLAY_MSG_DAMAGE:
+        if (msg.n_rects > DISPLAY_MAX_RECTS ||
+            len < (ssize_t)(offsetof(struct display_msg, rects) +
+                            msg.n_rects * sizeof msg.rects[0]))
+            return 1;
+        for (uint16_t i = 0; i < msg.n_rects; i++)
+            damage_add(&panels[msg.panel], msg.rects[i]);
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <spidev>\n", argv[0]);
+        return 1;
+    }
+
+    ili9341_spi_init(ILI9341_TFTWIDTH, ILI9341_TFTHEIGHT, dc_pin, rst_pin, argv[1]);
+    for (uint8_t i = 0; i < DISPLAY_PANELS; i++)
+    {
+        bcm2835_gpio_fsel(panels[i].cs_pin, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_write(panels[i].cs_pin, HIGH);
+    }
+    init_displays();
+    for (uint8_t i = 0; i < DISPLAY_PANELS; i++)
+    {
+        if (init_panel(&panels[i], i))
+            return 1;
+    }
+    flush_panels();
+
+    // no SA_RESTART, poll() has to return so we can clean up
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    struct pollfd pfds[1 + MAX_CLIENTS];
+    nfds_t nfds = 1;
+    pfds[0].fd = init_socket();
+    pfds[0].events = POLLIN;
+    if (pfds[0].fd < 0)
+        return 1;
+
+    while (!stop)
+    {
+        // no room for another client: leave new connections in the backlog,
+        // polling the listen socket would only report them again and again
+        pfds[0].events = nfds < 1 + MAX_CLIENTS ? POLLIN : 0;
+        if (poll(pfds, nfds, -1) < 0)
+        {
+            if (errno != EINTR)
+                perror("poll");
+            continue;
+        }
+
+        // drain every client first so their damage gets merged,
+        // then flush once
+        for (nfds_t i = 1; i < nfds; i++)
+        {
+            if (!pfds[i].revents)
+                continue;
+            // read pending damage before noticing a hangup
+            if (!(pfds[i].revents & POLLIN) || handle_client(pfds[i].fd))
+            {
+                close(pfds[i].fd);
+                pfds[i--] = pfds[--nfds];
+            }
+        }
+
+        if (pfds[0].revents & POLLIN)
+        {
+            int sock = accept4(pfds[0].fd, NULL, NULL, SOCK_CLOEXEC);
+            if (sock >= 0)
+            {
+                pfds[nfds].fd = sock;
+                pfds[nfds].events = POLLIN;
+                pfds[nfds++].revents = 0;
+            }
+        }
+
+        flush_panels();
+    }
+
+    for (nfds_t i = 0; i < nfds; i++)
+        close(pfds[i].fd);
+    unlink(DISPLAY_SOCKET);
+    for (uint8_t i = 0; i < DISPLAY_PANELS; i++)
+    {
+        munmap(panels[i].fb, (size_t)ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT * 2);
+        close(panels[i].fd_fb);
+    }
+    // closes spidev and a trace, then the GPIOs
+    ili9341_spi_close();
+    return 0;
+}
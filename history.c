@@ -0,0 +1,348 @@
+/*  compressed sample history, see history.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+
+// a Rice code with a quotient this big is written as escape + 64 bits
+#define RICE_ESCAPE 20
+// the Rice state forgets half of what it saw after this many values
+#define RICE_WINDOW 32
+// worst case size of one encoded sample
+#define MAX_SAMPLE_BITS ((4 + 64) + HISTORY_CHANNELS * (RICE_ESCAPE + 64))
+
+/*  variable length codes of timestamps, chosen by the zigzag encoded value
+ *      0                   value 0
+ *      10   + small bits
+ *      110  + medium bits
+ *      1110 + large bits
+ *      1111 + 64 bits
+ */
+struct code_widths {
+    uint8_t small, medium, large;
+};
+// regular intervals give dod 0, jitter of a few seconds small
+static const struct code_widths ts_widths = { 7, 9, 12 };
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void put_bits(struct history_block *b, uint64_t v, uint8_t n)
+{
+    while (n--)
+    {
+        uint32_t byte = b->bits >> 3;
+        uint8_t mask = 0x80 >> (b->bits & 7);
+        if (v >> n & 1)
+            b->data[byte] |= mask;
+        else
+            b->data[byte] &= ~mask;
+        b->bits++;
+    }
+}
+
+static uint64_t get_bits(const struct history_block *b, uint32_t *pos, uint8_t n)
+{
+    uint64_t v = 0;
+    while (n--)
+    {
+        v = v << 1 | (b->data[*pos >> 3] >> (7 - (*pos & 7)) & 1);
+        (*pos)++;
+    }
+    return v;
+}
+
+static void put_code(struct history_block *b, int64_t v, const struct code_widths *w)
+{
+    uint64_t z = zigzag(v);
+    if (!z)
+        put_bits(b, 0, 1);
+    else if (z >> w->small == 0)
+    {
+        put_bits(b, 2, 2);
+        put_bits(b, z, w->small);
+    }
+    else if (z >> w->medium == 0)
+    {
+        put_bits(b, 6, 3);
+        put_bits(b, z, w->medium);
+    }
+    else if (z >> w->large == 0)
+    {
+        put_bits(b, 14, 4);
+        put_bits(b, z, w->large);
+    }
+    else
+    {
+        put_bits(b, 15, 4);
+        put_bits(b, z, 64);
+    }
+}
+
+static int64_t get_code(const struct history_block *b, uint32_t *pos,
+                        const struct code_widths *w)
+{
+    uint8_t ones = 0;
+    while (ones < 4 && get_bits(b, pos, 1))
+        ones++;
+    switch (ones)
+    {
+    case 0:
+        return 0;
+    case 1:
+        return unzigzag(get_bits(b, pos, w->small));
+    case 2:
+        return unzigzag(get_bits(b, pos, w->medium));
+    case 3:
+        return unzigzag(get_bits(b, pos, w->large));
+    default:
+        return unzigzag(get_bits(b, pos, 64));
+    }
+}
+
+/*  Rice codes of the value deltas: z >> k in unary (ones and a zero),
+ *  then the low k bits of z. k is the smallest one with n << k >= sum,
+ *  roughly log2 of the mean recent z, like the context parameter in LOCO-I.
+ *  encoder and decoder update the state the same way after every value
+ */
+static void rice_reset(struct history_rice *r)
+{
+    r->sum = 4;
+    r->n = 1;
+}
+
+static uint8_t rice_k(const struct history_rice *r)
+{
+    uint8_t k = 0;
+    while (k < 32 && ((uint64_t)r->n << k) < r->sum)
+        k++;
+    return k;
+}
+
+static void rice_update(struct history_rice *r, uint64_t z)
+{
+    // big jumps must not stall the adaption for long, nor overflow sum
+    r->sum += z < (1 << 20) ? z : (1 << 20);
+    if (++r->n == RICE_WINDOW)
+    {
+        r->sum >>= 1;
+        r->n >>= 1;
+    }
+}
+
+static void put_rice(struct history_block *b, struct history_rice *r, int64_t v)
+{
+    uint64_t z = zigzag(v);
+    uint8_t k = rice_k(r);
+    uint64_t q = z >> k;
+
+    if (q < RICE_ESCAPE)
+    {
+        put_bits(b, ((1ull << q) - 1) << 1, q + 1);
+        put_bits(b, z, k);
+    }
+    else
+    {
+        put_bits(b, (1 << RICE_ESCAPE) - 1, RICE_ESCAPE);
+        put_bits(b, z, 64);
+    }
+    rice_update(r, z);
+}
+
+static int64_t get_rice(const struct history_block *b, uint32_t *pos,
+                        struct history_rice *r)
+{
+    uint8_t k = rice_k(r);
+    uint64_t q = 0, z;
+
+    while (q < RICE_ESCAPE && get_bits(b, pos, 1))
+        q++;
+    if (q < RICE_ESCAPE)
+        z = q << k | get_bits(b, pos, k);
+    else
+        z = get_bits(b, pos, 64);
+    rice_update(r, z);
+    return unzigzag(z);
+}
+
+static struct history_block *block(const struct history *h, uint32_t i)
+{
+    return &h->blocks[(h->head + i) % h->max_blocks];
+}
+
+int history_init(struct history *h, uint32_t max_bytes)
+{
+    h->max_blocks = max_bytes / sizeof (struct history_block);
+    if (h->max_blocks < 2)
+        h->max_blocks = 2;
+    h->blocks = malloc(h->max_blocks * sizeof *h->blocks);
+    if (!h->blocks)
+    {
+        perror("malloc");
+        return -1;
+    }
+    h->head = h->count = 0;
+    h->samples = 0;
+    return 0;
+}
+
+void history_free(struct history *h)
+{
+    free(h->blocks);
+    h->blocks = NULL;
+    h->count = 0;
+}
+
+// start a new block with sample t, vals, dropping the oldest if needed
+static void new_block(struct history *h, int64_t t, const int32_t *vals)
+{
+    if (h->count == h->max_blocks)
+    {
+        h->samples -= block(h, 0)->count;
+        h->head = (h->head + 1) % h->max_blocks;
+        h->count--;
+    }
+    struct history_block *b = block(h, h->count++);
+    b->t_first = b->t_last = t;
+    b->delta = 0;
+    b->count = 1;
+    b->bits = 0;
+    memcpy(b->first, vals, sizeof b->first);
+    memcpy(b->last, vals, sizeof b->last);
+    for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++)
+        rice_reset(&b->rice[ch]);
+}
+
+void history_append(struct history *h, int64_t t, const int32_t *vals)
+{
+    struct history_block *b = h->count ? block(h, h->count - 1) : NULL;
+
+    h->samples++;
+    if (!b || b->bits + MAX_SAMPLE_BITS > HISTORY_BLOCK_BYTES * 8)
+    {
+        new_block(h, t, vals);
+        return;
+    }
+
+    int64_t delta = t - b->t_last;
+    put_code(b, delta - b->delta, &ts_widths);
+    for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++)
+    {
+        put_rice(b, &b->rice[ch], (int64_t)vals[ch] - b->last[ch]);
+        b->last[ch] = vals[ch];
+    }
+    b->delta = delta;
+    b->t_last = t;
+    b->count++;
+}
+
+uint64_t history_count(const struct history *h)
+{
+    return h->samples;
+}
+
+uint64_t history_bytes(const struct history *h)
+{
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < h->count; i++)
+        bytes += sizeof (struct history_block) - HISTORY_BLOCK_BYTES +
+                 (block(h, i)->bits + 7) / 8;
+    return bytes;
+}
+
+int64_t history_last(const struct history *h, int32_t *vals)
+{
+    if (!h->count)
+        return -1;
+    const struct history_block *b = block(h, h->count - 1);
+    if (vals)
+        memcpy(vals, b->last, sizeof b->last);
+    return b->t_last;
+}
+
+// position it at the first sample of logical block i
+static void iter_block(struct history_iter *it, uint32_t i)
+{
+    it->block = i;
+    it->i = 0;
+    it->pos = 0;
+    it->delta = 0;
+    for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++)
+        rice_reset(&it->rice[ch]);
+}
+
+void history_seek(const struct history *h, struct history_iter *it, int64_t t)
+{
+    // first block that still has samples >= t, blocks are sorted by time
+    uint32_t lo = 0, hi = h->count;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (block(h, mid)->t_last < t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    it->h = h;
+    iter_block(it, lo);
+
+    // decode up to the sample before the first one >= t
+    struct history_iter peek = *it;
+    int64_t ts;
+    int32_t vals[HISTORY_CHANNELS];
+    while (history_next(&peek, &ts, vals) && ts < t)
+        *it = peek;
+}
+
+void history_seek_newest(const struct history *h, struct history_iter *it, uint64_t n)
+{
+    // samples to skip, whole blocks at once
+    uint64_t skip = n < h->samples ? h->samples - n : 0;
+    uint32_t i = 0;
+    while (i < h->count && skip >= block(h, i)->count)
+        skip -= block(h, i++)->count;
+    it->h = h;
+    iter_block(it, i);
+
+    int64_t t;
+    int32_t vals[HISTORY_CHANNELS];
+    while (skip--)
+        history_next(it, &t, vals);
+}
+
+int history_next(struct history_iter *it, int64_t *t, int32_t *vals)
+{
+    const struct history *h = it->h;
+
+    if (it->block < h->count && it->i == block(h, it->block)->count)
+        iter_block(it, it->block + 1);
+    if (it->block >= h->count)
+        return 0;
+
+    const struct history_block *b = block(h, it->block);
+    if (!it->i)
+    {
+        it->t = b->t_first;
+        memcpy(it->vals, b->first, sizeof it->vals);
+    }
+    else
+    {
+        it->delta += get_code(b, &it->pos, &ts_widths);
+        it->t += it->delta;
+        for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++)
+            it->vals[ch] += get_rice(b, &it->pos, &it->rice[ch]);
+    }
+    it->i++;
+    *t = it->t;
+    memcpy(vals, it->vals, sizeof it->vals);
+    return 1;
+}
@@ -0,0 +1,82 @@
+/*  compressed sample history
+ *
+ *  keeps (timestamp, value per channel) samples in fixed-size blocks,
+ *  Gorilla style: timestamps as delta-of-delta, values as the delta to the
+ *  previous value of their channel. (Gorilla XORs float values, our values
+ *  are integers * 100, plain deltas compress them better.)
+ *
+ *  timestamps use a few fixed variable length codes, a regular interval
+ *  takes 1 bit. the value deltas of a sensor are mostly its noise, they
+ *  get Rice codes whose parameter follows the recent magnitude of each
+ *  channel, so a quiet and a noisy channel both end up close to their
+ *  entropy. a per-minute BME280 log takes about 1.7 bytes per sample,
+ *  months of samples fit in a few MB.
+ *
+ *  writes are append only, samples have to come in in timestamp order.
+ *  once the memory given to history_init() is used up, the oldest block
+ *  gets dropped. reading decodes sequentially from the first block that
+ *  covers the requested start time.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+#define HISTORY_CHANNELS 3
+#define HISTORY_BLOCK_BYTES 4096    // encoded data per block
+
+// adaptive Rice parameter of one channel, see rice_k()
+struct history_rice {
+    uint32_t sum;       // of the recent zigzag encoded deltas
+    uint32_t n;         // number of them
+};
+
+struct history_block {
+    int64_t t_first, t_last;
+    int32_t first[HISTORY_CHANNELS];   // values of the first sample, not encoded
+    uint32_t count;                     // samples in the block
+    uint32_t bits;                      // encoded bits in data
+    // encoder state, to continue appending
+    int64_t delta;                      // between the last two timestamps
+    int32_t last[HISTORY_CHANNELS];
+    struct history_rice rice[HISTORY_CHANNELS];
+    uint8_t data[HISTORY_BLOCK_BYTES];
+};
+
+struct history {
+    struct history_block *blocks;
+    uint32_t max_blocks;
+    uint32_t head;      // oldest block
+    uint32_t count;     // blocks in use, the newest one is being appended to
+    uint64_t samples;
+};
+
+struct history_iter {
+    const struct history *h;
+    uint32_t block;     // logical index, 0 = oldest
+    uint32_t i;         // next sample in the block
+    uint32_t pos;       // next bit in the block
+    int64_t t, delta;
+    int32_t vals[HISTORY_CHANNELS];
+    struct history_rice rice[HISTORY_CHANNELS];
+};
+
+// use about max_bytes of memory, returns -1 on error
+int history_init(struct history *h, uint32_t max_bytes);
+void history_free(struct history *h);
+// add a sample taken at time t, vals holds one value per channel
+void history_append(struct history *h, int64_t t, const int32_t *vals);
+// samples kept and the memory they take up
+uint64_t history_count(const struct history *h);
+uint64_t history_bytes(const struct history *h);
+// time of the newest sample and its values (if vals isn't NULL), -1 if empty
+int64_t history_last(const struct history *h, int32_t *vals);
+// start reading at the first sample with a timestamp >= t
+void history_seek(const struct history *h, struct history_iter *it, int64_t t);
+// start reading at the n-th newest sample, or the oldest if there are fewer
+void history_seek_newest(const struct history *h, struct history_iter *it, uint64_t n);
+// next sample, returns 0 once there are no more
+int history_next(struct history_iter *it, int64_t *t, int32_t *vals);
+
+#endif // HISTORY_H
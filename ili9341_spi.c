@@ -46,14 +46,17 @@
 #include <linux/spi/spidev.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <bcm2835.h>
 
 #include "ili9341_spi.h"
 #include "glcdfont.h"
+#include "spi_trace.h"
 
-#define ILI9341_SPI_DC_LOW() bcm2835_gpio_write(_dc_pin, LOW)// Command mode
-#define ILI9341_SPI_DC_HIGH() bcm2835_gpio_write(_dc_pin, HIGH)// Data mode
+#define ILI9341_SPI_DC_LOW() (trace_dc = 1, bcm2835_gpio_write(_dc_pin, LOW))// Command mode
+#define ILI9341_SPI_DC_HIGH() (trace_dc = 0, bcm2835_gpio_write(_dc_pin, HIGH))// Data mode
 
 #define ILI9341_RST_LOW() bcm2835_gpio_write(_rst_pin, LOW)
 #define ILI9341_RST_HIGH() bcm2835_gpio_write(_rst_pin, HIGH)
@@ -77,9 +80,47 @@ void ili9341_spi_init(uint16_t width, uint16_t height, uint8_t dc_pin,
 
     init_spidev(spidev);
     init_gpio();
+
+    // record the bus traffic of any program, see spi_trace.h
+    if (getenv("ILI9341_TRACE"))
+        ili9341_trace_open(getenv("ILI9341_TRACE"));
 }
 
 int fd; // SPIDEV file descriptor
+static uint64_t bus_bytes = 0; // bytes sent to the display, for statistics
+
+// optional copy of GRAM of the selected panel, row-major, see ili9341_shadow()
+static uint16_t *shadow = NULL;
+static uint8_t offscreen = 0;   // only draw into shadow, nothing goes out
+// takes the drawing calls instead of the bus, see ili9341_record()
+static const struct ili9341_recorder *recorder = NULL;
+// window set by the last setAddrWindow() and the GRAM position written next
+static uint16_t win_x1, win_y1, win_x2, win_y2;
+static uint16_t cur_x, cur_y;
+
+// command stream recorder, see spi_trace.h
+static FILE *trace = NULL;
+static uint8_t trace_dc = 0;    // DC is low, bytes sent are commands
+static uint8_t trace_site = 0;
+static const char *trace_sites[SPI_TRACE_SITES];
+static uint16_t trace_n_sites = 1;
+static uint64_t trace_last;     // usec of the last record
+// small data writes (command arguments) are merged into one record
+static uint8_t trace_pending[64];
+static uint8_t trace_pending_len = 0;
+static uint64_t trace_pending_end;
+
+// release spidev and the GPIOs taken by ili9341_spi_init()
+void ili9341_spi_close()
+{
+    ili9341_trace_close();
+    close(fd);
+    fd = -1;
+    // leave the pins as inputs like we found them
+    bcm2835_gpio_fsel(_dc_pin, BCM2835_GPIO_FSEL_INPT);
+    bcm2835_gpio_fsel(_rst_pin, BCM2835_GPIO_FSEL_INPT);
+    bcm2835_close();
+}
 
 // initialization commands for ILI9341 Display
 static const uint8_t initcmd[] = {
@@ -124,6 +165,7 @@ static int sendCommand(uint8_t cmd, const uint8_t *addr, uint8_t numArgs)
 
     // send command with activated Data/Control bit
     ILI9341_SPI_DC_LOW();
+    bus_bytes += 1 + numArgs;
     uint8_t status = ioctl(fd, SPI_IOC_MESSAGE(1), xfer);
     if (status < 0) {
         printf("error\n");
@@ -131,6 +173,7 @@ static int sendCommand(uint8_t cmd, const uint8_t *addr, uint8_t numArgs)
         //bcm2835_close();
         return 1;
     }
+    traceBytes(&cmd, 1);
     ILI9341_SPI_DC_HIGH();
 
     // send Command Arguments if we have any
@@ -147,6 +190,7 @@ static int sendCommand(uint8_t cmd, const uint8_t *addr, uint8_t numArgs)
             //bcm2835_close();
             return 1;
         }
+        traceBytes(addr, numArgs);
     }
 	//bcm2835_gpio_write(cs_pin, HIGH);
 }
@@ -180,6 +224,7 @@ static uint8_t readcommand8(uint8_t commandByte)//, uint8_t index) {
 
   ILI9341_SPI_DC_LOW(); // Command mode
   write(fd, &commandByte, 1);
+  traceBytes(&commandByte, 1);
   ILI9341_SPI_DC_HIGH(); // Data mode
 
   read(fd, &result, 1);
@@ -189,7 +234,11 @@ static uint8_t readcommand8(uint8_t commandByte)//, uint8_t index) {
 // send 1 Byte to ILI9341
 static void SPI_WRITE8(uint8_t value)
 {
+    if (offscreen)
+        return;
+    bus_bytes += 1;
     write(fd, &value, 1);
+    traceBytes(&value, 1);
 }
 
 // send 2 Bytes to ILI9341
@@ -197,13 +246,19 @@ static void SPI_WRITE16(uint16_t value)
 {
     uint8_t msb = value >> 8; 
     uint8_t lsb = (uint8_t)value; 
+    if (offscreen)
+        return;
+    bus_bytes += 2;
     write(fd, &msb, 1);
     write(fd, &lsb, 1);
+    traceBytes((uint8_t[]) { msb, lsb }, 2);
 }
 
 // send 1Byte command to ILI9341
 static void writeCommand(uint8_t cmd)
 {
+    if (offscreen)
+        return;
     ILI9341_SPI_DC_LOW();
     SPI_WRITE8(cmd);
     ILI9341_SPI_DC_HIGH();
@@ -220,13 +275,65 @@ static void setAddrWindow(uint16_t x1, uint16_t y1, uint16_t w,
   SPI_WRITE16(y1);
   SPI_WRITE16(y2);
   writeCommand(ILI9341_RAMWR); // Write to RAM
+
+  win_x1 = cur_x = x1;
+  win_y1 = cur_y = y1;
+  win_x2 = x2;
+  win_y2 = y2;
+}
+
+// advance the shadow write position by one pixel
+// the window fills column by column with y running fastest, wrapping around
+// at its end just like GRAM does
+static inline void shadowNext()
+{
+  if (cur_y++ == win_y2)
+  {
+    cur_y = win_y1;
+    if (cur_x++ == win_x2)
+      cur_x = win_x1;
+  }
+}
+
+// mirror len pixels of one color written to the current window
+static void shadowFill(uint16_t color, uint32_t len)
+{
+  while (len)
+  {
+    // rest of the current column in one go
+    uint32_t run = win_y2 - cur_y + 1;
+    if (run > len)
+      run = len;
+    uint16_t *p = shadow + (uint32_t)cur_y * ILI9341_TFTWIDTH + cur_x;
+    for (uint32_t i = 0; i < run; i++, p += ILI9341_TFTWIDTH)
+      *p = color;
+    len -= run;
+    cur_y += run - 1;
+    shadowNext();
+  }
+}
+
+// mirror big endian pixel data written to the current window
+static void shadowBytes(const uint8_t *buf, uint32_t len)
+{
+  for (uint32_t i = 0; i + 1 < len; i += 2)
+  {
+    shadow[(uint32_t)cur_y * ILI9341_TFTWIDTH + cur_x] = buf[i] << 8 | buf[i + 1];
+    shadowNext();
+  }
 }
 
 // control one pixel
 void writePixel(int16_t x, int16_t y, uint16_t color) {
   if ((x >= 0) && (x < _width) && (y >= 0) && (y < _height)) {
+    if (recorder && !offscreen) {
+      recorder->rect(x, y, 1, 1, color);
+      return;
+    }
     setAddrWindow(x, y, 1, 1);
     SPI_WRITE16(color);
+    if (shadow)
+      shadowFill(color, 1);
   }
 }
 
@@ -238,6 +345,11 @@ static int writeColor(uint16_t color, uint32_t len)
 {
     if (!len)
         return 0; // Avoid 0-byte transfers
+    if (offscreen)
+    {
+        shadowFill(color, len);
+        return 0;
+    }
 
     // max buf len per ioctl call is 2048
     int max_len = 2048;
@@ -251,13 +363,495 @@ static int writeColor(uint16_t color, uint32_t len)
         buf[2*i+1] = lo;
     }
 
+    bus_bytes += (uint64_t)len * 2;
+    if (shadow)
+        shadowFill(color, len);
     int iterations = len / max_len;
     while (iterations--) {
         write(fd, buf, max_len*2);
     }
     write(fd, buf, (len % max_len)*2);
+    traceFill(color, len);
+
+    free(buf);
+}
+
+// send a buffer of raw bytes, split into spidev sized chunks
+static int writeBytes(const uint8_t *buf, uint32_t len)
+{
+    if (shadow)
+        shadowBytes(buf, len);
+    if (offscreen)
+        return 0;
+    bus_bytes += len;
+    for (uint32_t done = 0; done < len; )
+    {
+        uint32_t chunk = len - done < ILI9341_SPI_MAX_XFER ? len - done : ILI9341_SPI_MAX_XFER;
+        if (write(fd, buf + done, chunk) < 0)
+        {
+            perror("write");
+            return 1;
+        }
+        done += chunk;
+    }
+    traceBytes(buf, len);
+    return 0;
+}
+
+static uint64_t traceNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// append one record, end is when its transfer finished
+static void traceRecord(uint8_t type, uint16_t arg, uint32_t len,
+                        const void *payload, uint64_t end)
+{
+    struct spi_trace_rec rec = {
+        .type = type,
+        .site = trace_site,
+        .arg = arg,
+        .len = len,
+        .usec = end - trace_last,
+    };
+    trace_last = end;
+    fwrite(&rec, sizeof rec, 1, trace);
+    if (payload)
+        fwrite(payload, 1, len, trace);
+}
+
+// write out the merged small data writes
+static void traceFlush()
+{
+    if (!trace_pending_len)
+        return;
+    traceRecord(SPI_TRACE_DATA, 0, trace_pending_len, trace_pending, trace_pending_end);
+    trace_pending_len = 0;
+}
+
+// record bytes that just went out, commands or data depending on DC
+static void traceBytes(const uint8_t *buf, uint32_t len)
+{
+    if (!trace)
+        return;
+    uint64_t now = traceNow();
+    if (trace_dc)
+    {
+        traceFlush();
+        for (uint32_t i = 0; i < len; i++)
+            traceRecord(SPI_TRACE_CMD, buf[i], 0, NULL, now);
+    }
+    else if (trace_pending_len + len <= sizeof trace_pending)
+    {
+        memcpy(trace_pending + trace_pending_len, buf, len);
+        trace_pending_len += len;
+        trace_pending_end = now;
+    }
+    else
+    {
+        traceFlush();
+        traceRecord(SPI_TRACE_DATA, 0, len, buf, now);
+    }
+}
+
+// record len pixels of color that just went out
+static void traceFill(uint16_t color, uint32_t len)
+{
+    if (!trace)
+        return;
+    uint64_t now = traceNow();
+    traceFlush();
+    traceRecord(SPI_TRACE_FILL, color, len, NULL, now);
+}
+
+// draw a row-major bitmap of 16bit colors, stride is given in pixels
+// x is mapped to the page address (see setAddrWindow()), so the panel
+// expects the pixels of a window column by column with y running fastest;
+// transpose and byte swap through a small bounce buffer while sending
+void drawRGBBitmap(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                    const uint16_t *bitmap, uint16_t stride)
+{
+  if ((x < 0) || (y < 0) || (x + width > _width) || (y + height > _height) ||
+      !width || !height)
+    return;
+
+  if (recorder && !offscreen)
+  {
+    recorder->bitmap(x, y, width, height, bitmap, stride);
+    return;
+  }
+
+  uint8_t buf[ILI9341_SPI_MAX_XFER];
+  uint32_t n = 0;
+
+  setAddrWindow(x, y, width, height);
+  for (uint16_t i = 0; i < width; i++)
+  {
+    for (uint16_t j = 0; j < height; j++)
+    {
+      uint16_t color = bitmap[(uint32_t)j * stride + i];
+      buf[n++] = color >> 8;
+      buf[n++] = color;
+      if (n == sizeof buf)
+      {
+        writeBytes(buf, n);
+        n = 0;
+      }
+    }
+  }
+  writeBytes(buf, n);
+}
+
+// stream pixels that are already in panel order into a window
+// data holds width*height big endian RGB565 values, y running fastest,
+// and goes to the bus without being copied (e.g. straight from a mmap)
+void drawRawPixels(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                    const uint8_t *data)
+{
+  if ((x < 0) || (y < 0) || (x + width > _width) || (y + height > _height) ||
+      !width || !height)
+    return;
+
+  setAddrWindow(x, y, width, height);
+  writeBytes(data, (uint32_t)width * height * 2);
+}
+
+// stream procedurally generated pixels into one window, column by column
+// the panel fills a window with y running fastest, so a column is exactly
+// the next height pixels of the stream. func renders one column into a
+// small line buffer which gets sent while the next ones are generated,
+// no framebuffer needed
+void drawColumns(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                    column_func func, void *arg)
+{
+  if ((x < 0) || (y < 0) || (x + width > _width) || (y + height > _height) ||
+      !width || !height)
+    return;
+
+  uint16_t line[ILI9341_TFTWIDTH];
+
+  if (recorder && !offscreen)
+  {
+    // runs of one color within a column become rectangles
+    for (uint16_t i = 0; i < width; i++)
+    {
+      func(i, line, height, arg);
+      for (uint16_t j = 0, k; j < height; j = k)
+      {
+        for (k = j + 1; k < height && line[k] == line[j]; k++)
+          ;
+        recorder->rect(x + i, y + j, 1, k - j, line[j]);
+      }
+    }
+    return;
+  }
+
+  uint8_t buf[ILI9341_SPI_MAX_XFER];
+  uint32_t n = 0;
+
+  setAddrWindow(x, y, width, height);
+  for (uint16_t i = 0; i < width; i++)
+  {
+    func(i, line, height, arg);
+    for (uint16_t j = 0; j < height; j++)
+    {
+      buf[n++] = line[j] >> 8;
+      buf[n++] = line[j];
+      if (n == sizeof buf)
+      {
+        writeBytes(buf, n);
+        n = 0;
+      }
+    }
+  }
+  writeBytes(buf, n);
+}
+
+// color i of n steps from color1 to color2
+// interpolates red, green and blue separately
+static uint16_t blendColor(uint16_t color1, uint16_t color2, uint16_t i,
+                                     uint16_t n)
+{
+  if (n < 2)
+    return color1;
+  int32_t r1 = color1 >> 11, g1 = color1 >> 5 & 0x3f, b1 = color1 & 0x1f;
+  int32_t r2 = color2 >> 11, g2 = color2 >> 5 & 0x3f, b2 = color2 & 0x1f;
+  int32_t d = n - 1;
+  uint16_t r = r1 + ((r2 - r1) * i + d / 2) / d;
+  uint16_t g = g1 + ((g2 - g1) * i + d / 2) / d;
+  uint16_t b = b1 + ((b2 - b1) * i + d / 2) / d;
+  return r << 11 | g << 5 | b;
+}
+
+// fill a rectangle with a gradient from color1 to color2
+// the colors get computed once into a table that is already in panel byte
+// order, then the whole rectangle is streamed through one window
+void fillRectGradient(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                    uint16_t color1, uint16_t color2, uint8_t direction)
+{
+  if ((x < 0) || (y < 0) || (x + width > _width) || (y + height > _height) ||
+      !width || !height)
+    return;
+
+  uint16_t steps = direction == GRADIENT_VERTICAL ? height : width;
+  if (recorder && !offscreen)
+  {
+    // one rectangle per step
+    for (uint16_t i = 0; i < steps; i++)
+    {
+      uint16_t color = blendColor(color1, color2, i, steps);
+      if (direction == GRADIENT_VERTICAL)
+        recorder->rect(x, y + i, width, 1, color);
+      else
+        recorder->rect(x + i, y, 1, height, color);
+    }
+    return;
+  }
+
+  uint8_t lut[2 * ILI9341_TFTWIDTH];
+  for (uint16_t i = 0; i < steps; i++)
+  {
+    uint16_t color = blendColor(color1, color2, i, steps);
+    lut[2 * i] = color >> 8;
+    lut[2 * i + 1] = color;
+  }
+
+  uint8_t buf[ILI9341_SPI_MAX_XFER];
+  uint32_t n = 0;
+
+  setAddrWindow(x, y, width, height);
+  // the window fills column by column, y running fastest
+  for (uint16_t i = 0; i < width; i++)
+  {
+    for (uint16_t j = 0; j < height; j++)
+    {
+      const uint8_t *c = lut + 2 * (direction == GRADIENT_VERTICAL ? j : i);
+      buf[n++] = c[0];
+      buf[n++] = c[1];
+      if (n == sizeof buf)
+      {
+        writeBytes(buf, n);
+        n = 0;
+      }
+    }
+  }
+  writeBytes(buf, n);
+}
 
+struct shade_args {
+  shade_func func;
+  void *arg;
+};
+
+static void shadeColumn(uint16_t col, uint16_t *line, uint16_t height, void *arg)
+{
+  struct shade_args *sa = arg;
+  for (uint16_t j = 0; j < height; j++)
+    line[j] = sa->func(col, j, sa->arg);
+}
+
+// fill a rectangle with colors computed per pixel, through one window
+void fillRectShaded(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                    shade_func func, void *arg)
+{
+  struct shade_args sa = { func, arg };
+  drawColumns(x, y, width, height, shadeColumn, &sa);
+}
+
+// number of bytes sent over the bus since ili9341_spi_init()
+uint64_t ili9341_bus_bytes()
+{
+    return bus_bytes;
+}
+
+// start recording the bus traffic to path, see spi_trace.h
+int ili9341_trace_open(const char *path)
+{
+    struct spi_trace_header hdr = { SPI_TRACE_MAGIC, SPI_TRACE_VERSION };
+
+    ili9341_trace_close();
+    trace = fopen(path, "w");
+    if (!trace)
+    {
+        perror(path);
+        return 1;
+    }
+    // big buffer, the recorder should not show up in the timings
+    setvbuf(trace, NULL, _IOFBF, 1 << 16);
+    fwrite(&hdr, sizeof hdr, 1, trace);
+    trace_site = 0;
+    trace_n_sites = 1;
+    trace_pending_len = 0;
+    trace_last = traceNow();
+    return 0;
+}
+
+void ili9341_trace_close()
+{
+    if (!trace)
+        return;
+    traceFlush();
+    fclose(trace);
+    trace = NULL;
+}
+
+// label everything sent from now on with site, a string that stays around
+void ili9341_trace_site(const char *site)
+{
+    if (!trace)
+        return;
+    traceFlush();
+    if (!site)
+    {
+        trace_site = 0;
+        return;
+    }
+    // sites are usually string literals, comparing pointers is enough
+    for (uint16_t i = 1; i < trace_n_sites; i++)
+    {
+        if (trace_sites[i] == site)
+        {
+            trace_site = i;
+            return;
+        }
+    }
+    if (trace_n_sites == SPI_TRACE_SITES)
+    {
+        trace_site = 0;     // out of ids, goes under "no site"
+        return;
+    }
+    trace_sites[trace_n_sites] = site;
+    trace_site = trace_n_sites++;
+    traceRecord(SPI_TRACE_SITE, trace_site, strlen(site), site, trace_last);
+}
+
+// a frame on panel starts, for the overdraw statistics
+void ili9341_trace_frame(uint8_t panel)
+{
+    if (!trace)
+        return;
+    traceFlush();
+    traceRecord(SPI_TRACE_FRAME, panel, 0, NULL, traceNow());
+}
+
+// keep a copy of GRAM in buf while drawing, NULL stops it
+// buf holds ILI9341_SHADOW_PIXELS colors and belongs to the panel that is
+// selected, so switch it together with the chip select when there are
+// several panels on the bus. it only knows what got drawn while it was
+// selected, start with a full screen fill
+void ili9341_shadow(uint16_t *buf)
+{
+    shadow = buf;
+    offscreen = 0;
+}
+
+// draw into buf instead of the display, nothing goes over the bus
+// buf is laid out like a shadow, NULL goes back to drawing on the display
+// (without a shadow)
+void ili9341_offscreen(uint16_t *buf)
+{
+    shadow = buf;
+    offscreen = buf != NULL;
+}
+
+// hand the drawing calls to r instead of sending them, NULL sends again.
+// offscreen drawing and drawRawPixels() are not recorded
+void ili9341_record(const struct ili9341_recorder *r)
+{
+    recorder = r;
+}
+
+// make the display show buf (laid out like a shadow) by only sending the
+// pixels that differ from the shadow: one window per run of changed pixels
+// in a column, runs less than PRESENT_GAP apart get merged since a window
+// costs about as much as that many pixels. if most of the screen changes
+// it goes out as a single window instead. needs a shadow
+void presentBuffer(const uint16_t *buf)
+{
+  uint32_t changed = 0;
+
+  if (!shadow || offscreen)
+    return;
+  for (uint32_t i = 0; i < (uint32_t)_width * _height; i++)
+  {
+    uint32_t k = i / _width * ILI9341_TFTWIDTH + i % _width;
+    changed += shadow[k] != buf[k];
+  }
+  if (!changed)
+    return;
+  if (changed > (uint32_t)_width * _height / 2)
+  {
+    drawRGBBitmap(0, 0, _width, _height, buf, ILI9341_TFTWIDTH);
+    return;
+  }
+
+  for (uint16_t x = 0; x < _width; x++)
+  {
+    int32_t start = -1, last = -1;
+    for (uint16_t y = 0; y <= _height; y++)
+    {
+      uint8_t diff = y < _height &&
+                     shadow[(uint32_t)y * ILI9341_TFTWIDTH + x] != buf[(uint32_t)y * ILI9341_TFTWIDTH + x];
+      if (diff)
+      {
+        if (start < 0)
+          start = y;
+        last = y;
+      }
+      else if (start >= 0 && (y == _height || y - last > PRESENT_GAP))
+      {
+        drawRGBBitmap(x, start, 1, last - start + 1,
+                      buf + (uint32_t)start * ILI9341_TFTWIDTH + x, ILI9341_TFTWIDTH);
+        start = -1;
+      }
+    }
+  }
+}
+
+// color of one pixel from the shadow, 0 without one
+uint16_t readPixel(int16_t x, int16_t y)
+{
+  if (!shadow || (x < 0) || (x >= _width) || (y < 0) || (y >= _height))
+    return 0;
+  return shadow[(uint32_t)y * ILI9341_TFTWIDTH + x];
+}
+
+// copy a rectangle from the shadow into a row-major buffer, no bus reads
+// returns 1 without a shadow or if the rectangle is off screen
+int readRect(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t *buf)
+{
+  if (!shadow || (x < 0) || (y < 0) || (x + width > _width) ||
+      (y + height > _height))
+    return 1;
+
+  for (uint16_t j = 0; j < height; j++)
+    memcpy(buf + (uint32_t)j * width, shadow + (uint32_t)(y + j) * ILI9341_TFTWIDTH + x,
+           width * sizeof *buf);
+  return 0;
+}
+
+// save what is under a rectangle, e.g. before opening a popup on top of it
+// returns a malloc'd copy to hand to restoreRegion(), NULL on error
+uint16_t *saveRegion(int16_t x, int16_t y, uint16_t width, uint16_t height)
+{
+  uint16_t *buf = malloc((uint32_t)width * height * sizeof *buf);
+  if (buf && readRect(x, y, width, height, buf))
+  {
     free(buf);
+    buf = NULL;
+  }
+  return buf;
+}
+
+// draw a region saved by saveRegion() back and free it
+void restoreRegion(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t *buf)
+{
+  if (!buf)
+    return;
+  drawRGBBitmap(x, y, width, height, buf, width);
+  free(buf);
 }
 
 // draw a filled rectangle
@@ -265,12 +859,35 @@ void fillRect(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t co
 {
   if ((x >= 0) && (x < _width) && (y >= 0) && (y < _height)) {
     if ((x + width <= _width) && (y + height <= _height)) {
+        if (recorder && !offscreen) {
+            recorder->rect(x, y, width, height, color);
+            return;
+        }
         setAddrWindow(x, y, width, height);
         writeColor(color, (uint32_t)width*height);
     }
   }
 }
 
+// set up hardware scrolling: top and bottom lines stay fixed, the ones in
+// between make up the scroll area. lines are GRAM pages, i.e. x here
+void setScrollMargins(uint16_t top, uint16_t bottom)
+{
+  if (top + bottom > ILI9341_TFTWIDTH)
+    return;
+  writeCommand(ILI9341_VSCRDEF);
+  SPI_WRITE16(top);
+  SPI_WRITE16(ILI9341_TFTWIDTH - top - bottom);
+  SPI_WRITE16(bottom);
+}
+
+// show line first at the start of the scroll area, GRAM stays untouched
+void scrollTo(uint16_t line)
+{
+  writeCommand(ILI9341_VSCRSADD);
+  SPI_WRITE16(line);
+}
+
 // invert the colors of the whole display
 void invert(uint8_t mode)
 {
@@ -300,6 +917,13 @@ void drawChar(int16_t x, int16_t y, unsigned char c,
   if (c >= 176)
     c++; // Handle 'classic' charset behavior
 
+  // a partly visible char goes pixel by pixel below, clipped like here
+  if (recorder && !offscreen && x >= 0 && y >= 0 &&
+      x + 6 * size_x <= _width && y + 8 * size_y <= _height) {
+    recorder->chr(x, y, c, color, bg, size_x, size_y);
+    return;
+  }
+
   for (int8_t i = 0; i < 5; i++) { // Char bitmap = 5 columns
     uint8_t line = font[c * 5 + i];//pgm_read_byte(&font[c * 5 + i]);
     for (int8_t j = 7; j >= 0; j--, line >>= 1) {
@@ -337,7 +961,7 @@ static int init_spidev(char *name)
         exit(1);
     }
 
-    uint32_t spi_speed = 50000000;        //1000000 = 1MHz (1uS per bit) 
+    uint32_t spi_speed = ILI9341_SPI_SPEED_HZ;  //1000000 = 1MHz (1uS per bit) 
     uint8_t status_value;
 
     status_value = ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &spi_speed);
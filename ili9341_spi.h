@@ -53,6 +53,11 @@
 
 #define ILI9341_TFTWIDTH 320  ///< ILI9341 max TFT width
 #define ILI9341_TFTHEIGHT 240 ///< ILI9341 max TFT height
+#define ILI9341_SHADOW_PIXELS (ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT) ///< size of a GRAM shadow
+#define PRESENT_GAP 6 ///< unchanged pixels worth sending to save a window
+
+#define ILI9341_SPI_SPEED_HZ 50000000 ///< SPI clock requested from spidev
+#define ILI9341_SPI_MAX_XFER 4096     ///< max bytes per write() (spidev bufsiz)
 
 #define ILI9341_NOP 0x00     ///< No-op register
 #define ILI9341_SWRESET 0x01 ///< Software reset register
@@ -133,12 +138,18 @@
 #define ILI9341_GREENYELLOW 0xAFE5 ///< 173, 255,  41
 #define ILI9341_PINK 0xFC18        ///< 255, 130, 198
 
+// directions for fillRectGradient()
+#define GRADIENT_HORIZONTAL 0 ///< color changes along x
+#define GRADIENT_VERTICAL 1   ///< color changes along y
+
 
 /********************* Public functions ***************************************/
 
 // init library
 void ili9341_spi_init(uint16_t width, uint16_t height, uint8_t dc_pin, 
                         uint8_t rst_pin, char *spidev);
+// release spidev and GPIOs again
+void ili9341_spi_close();
 // initialize ILI9341 Display
 void begin();
 // do a hardware reset
@@ -150,12 +161,73 @@ void fillRect(int16_t x, int16_t y, uint16_t width, uint16_t height,
                 uint16_t color);
 // invert the colors of the whole display
 void invert(uint8_t mode);
+// hardware scrolling along x (the GRAM page address, see setAddrWindow())
+void setScrollMargins(uint16_t top, uint16_t bottom);
+void scrollTo(uint16_t line);
 // draw an ASCII char on the display
 void drawChar(int16_t x, int16_t y, unsigned char c,
                           uint16_t color, uint16_t bg, uint8_t size_x,
                           uint8_t size_y);
 // control one pixel
 void writePixel(int16_t x, int16_t y, uint16_t color);
+// draw a row-major bitmap of 16bit colors, stride is given in pixels
+void drawRGBBitmap(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                    const uint16_t *bitmap, uint16_t stride);
+// stream pixels that are already in panel order into a window
+// (big endian, y running fastest, see drawRawPixels())
+void drawRawPixels(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                    const uint8_t *data);
+// generate the colors of one column of a window, y ascending
+typedef void (*column_func)(uint16_t col, uint16_t *line, uint16_t height,
+                            void *arg);
+// stream procedurally generated pixels into one window, column by column
+void drawColumns(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                    column_func func, void *arg);
+// fill a rectangle with a gradient from color1 to color2
+void fillRectGradient(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                    uint16_t color1, uint16_t color2, uint8_t direction);
+// color of pixel col, row of a rectangle filled by fillRectShaded()
+typedef uint16_t (*shade_func)(uint16_t col, uint16_t row, void *arg);
+// fill a rectangle with colors computed per pixel
+void fillRectShaded(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                    shade_func func, void *arg);
+// number of bytes sent over the bus since ili9341_spi_init()
+uint64_t ili9341_bus_bytes();
+// keep a copy of GRAM of the selected panel in buf, NULL turns it off
+void ili9341_shadow(uint16_t *buf);
+// draw into buf only, NULL draws on the display again
+void ili9341_offscreen(uint16_t *buf);
+// takes the drawing calls while set, see ili9341_record()
+// chr gets c after the 'classic' charset fixup of drawChar()
+struct ili9341_recorder {
+  void (*rect)(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                uint16_t color);
+  void (*chr)(int16_t x, int16_t y, unsigned char c, uint16_t color,
+                uint16_t bg, uint8_t size_x, uint8_t size_y);
+  // bitmap is only valid during the call
+  void (*bitmap)(int16_t x, int16_t y, uint16_t width, uint16_t height,
+                const uint16_t *bitmap, uint16_t stride);
+};
+// record fillRect(), writePixel(), drawChar(), drawRGBBitmap(),
+// drawColumns() and fillRectGradient() into r instead of drawing them,
+// NULL draws again
+void ili9341_record(const struct ili9341_recorder *r);
+// send what differs between buf and the shadow
+void presentBuffer(const uint16_t *buf);
+// read back from the shadow, no bus traffic
+uint16_t readPixel(int16_t x, int16_t y);
+int readRect(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t *buf);
+// save what is under a rectangle and draw it back later
+uint16_t *saveRegion(int16_t x, int16_t y, uint16_t width, uint16_t height);
+void restoreRegion(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t *buf);
+// record the bus traffic to path (see spi_trace.h), also done by
+// ili9341_spi_init() if ILI9341_TRACE is set in the environment
+int ili9341_trace_open(const char *path);
+void ili9341_trace_close();
+// label what gets sent from now on, site has to stay around, NULL: none
+void ili9341_trace_site(const char *site);
+// a new frame on panel starts (the user program handles chip select)
+void ili9341_trace_frame(uint8_t panel);
 
 
 /********************* Private functions **************************************/
@@ -175,6 +247,26 @@ static void setAddrWindow(uint16_t x1, uint16_t y1, uint16_t w,
                                      uint16_t h);
 // color pixels that where defined by setAddrWindow() before
 static int writeColor(uint16_t color, uint32_t len);
+// send a buffer of raw bytes, split into spidev sized chunks
+static int writeBytes(const uint8_t *buf, uint32_t len);
+// color i of n steps from color1 to color2
+static uint16_t blendColor(uint16_t color1, uint16_t color2, uint16_t i,
+                                     uint16_t n);
+// advance the shadow write position by one pixel
+static inline void shadowNext();
+// mirror pixels written to the current window into the shadow
+static void shadowFill(uint16_t color, uint32_t len);
+static void shadowBytes(const uint8_t *buf, uint32_t len);
+// record what just went over the bus if a trace is open
+static void traceBytes(const uint8_t *buf, uint32_t len);
+static void traceFill(uint16_t color, uint32_t len);
+static void traceFlush();
+static void traceRecord(uint8_t type, uint16_t arg, uint32_t len,
+                        const void *payload, uint64_t end);
+static uint64_t traceNow();
+// column callback for drawColumns() used by fillRectShaded()
+static void shadeColumn(uint16_t col, uint16_t *line, uint16_t height,
+                                     void *arg);
 // init the spidev interface for communicating with the SPI driver
 static int init_spidev(char *name);
 // init GPIOs that we use for Reset and Data/Control line
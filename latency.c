@@ -0,0 +1,76 @@
+/*  latency histograms, see latency.h */
+
+#include <time.h>
+
+#include "latency.h"
+
+#define SUB (1 << LATENCY_SUB_BITS)
+
+// monotonic clock in microseconds
+uint64_t latency_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint16_t bucket(uint64_t us)
+{
+    if (us > UINT32_MAX)
+        us = UINT32_MAX;
+    if (us < SUB)
+        return us;
+    // position of the leading one, the next LATENCY_SUB_BITS bits pick the bucket
+    uint8_t msb = 63 - __builtin_clzll(us);
+    return ((msb - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) +
+           ((us >> (msb - LATENCY_SUB_BITS)) & (SUB - 1));
+}
+
+// largest value that goes into bucket i
+static uint64_t bucket_max(uint16_t i)
+{
+    if (i < SUB)
+        return i;
+    uint8_t msb = (i >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    uint64_t low = (1ull << msb) | (uint64_t)(i & (SUB - 1)) << (msb - LATENCY_SUB_BITS);
+    return low + (1ull << (msb - LATENCY_SUB_BITS)) - 1;
+}
+
+void latency_add(struct latency_hist *h, uint64_t us)
+{
+    h->buckets[bucket(us)]++;
+    h->count++;
+    if (us > h->max)
+        h->max = us;
+}
+
+// value below which permille of the values are, 0 if there are none
+uint64_t latency_percentile(const struct latency_hist *h, uint16_t permille)
+{
+    // rank of the value we are looking for, rounded up
+    uint64_t rank = (h->count * permille + 999) / 1000, seen = 0;
+
+    if (!rank)
+        return 0;
+    for (uint16_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if (seen >= rank)
+            return bucket_max(i) < h->max ? bucket_max(i) : h->max;
+    }
+    return h->max;
+}
+
+// one "name count p50 p99 max" line per histogram, with a header line
+void latency_print(FILE *f, const struct latency_hist *h, uint8_t n)
+{
+    fprintf(f, "%-10s %8s %10s %10s %10s\n", "stage", "count", "p50_us", "p99_us", "max_us");
+    for (uint8_t i = 0; i < n; i++)
+    {
+        fprintf(f, "%-10s %8llu %10llu %10llu %10llu\n", h[i].name,
+                (unsigned long long)h[i].count,
+                (unsigned long long)latency_percentile(&h[i], 500),
+                (unsigned long long)latency_percentile(&h[i], 990),
+                (unsigned long long)h[i].max);
+    }
+}
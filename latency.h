@@ -0,0 +1,35 @@
+/*  latency histograms
+ *
+ *  log-linear buckets of microseconds: exact below 8 us, then 8 buckets
+ *  per power of two, so a bucket is at most 12.5% wide. fixed size and
+ *  allocation free, adding a value is a count leading zeros and an
+ *  increment. percentiles are the upper bound of the bucket they fall
+ *  into, capped by the exact maximum.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define LATENCY_SUB_BITS 3  // 2^LATENCY_SUB_BITS buckets per power of two
+// enough for 2^32 us (71 minutes), longer ones end up in the last bucket
+#define LATENCY_BUCKETS ((32 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+struct latency_hist {
+    const char *name;
+    uint64_t count;
+    uint64_t max;
+    uint32_t buckets[LATENCY_BUCKETS];
+};
+
+// monotonic clock in microseconds
+uint64_t latency_now();
+void latency_add(struct latency_hist *h, uint64_t us);
+// value below which permille of the values are, 0 if there are none
+uint64_t latency_percentile(const struct latency_hist *h, uint16_t permille);
+// one "name count p50 p99 max" line per histogram, with a header line
+void latency_print(FILE *f, const struct latency_hist *h, uint8_t n);
+
+#endif // LATENCY_H
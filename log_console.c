@@ -0,0 +1,127 @@
+/*  tail a log file on one of the displays
+ *
+ *  usage: log_console <spidev> <logfile> [display 0|1]
+ *
+ *  new lines of the log are printed to a hardware scrolled console (see
+ *  console.h), so every line costs one line of pixels no matter how much
+ *  text is on screen. the header shows the file name, the footer how many
+ *  lines came in. rotation of the log is followed like in weather_graph.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+
+#include <bcm2835.h>
+#include "ili9341_spi.h"
+#include "log_reader.h"
+#include "console.h"
+
+static uint8_t dc_pin = RPI_V2_GPIO_P1_22;
+static uint8_t rst_pin = RPI_V2_GPIO_P1_18;
+static uint8_t cs_pins[] = { RPI_V2_GPIO_P1_13, RPI_V2_GPIO_P1_16 };
+
+static volatile sig_atomic_t stop = 0;
+static struct console con;
+static uint64_t line_count = 0;
+
+static void on_signal(int sig)
+{
+    stop = 1;
+}
+
+static void print_line(char *line, size_t len, void *arg)
+{
+    console_print(&con, line);
+    line_count++;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s <spidev> <logfile> [display 0|1]\n", argv[0]);
+        return 1;
+    }
+    int display = argc > 3 ? atoi(argv[3]) & 1 : 0;
+    const char *path = argv[2];
+
+    // start at the end, only new lines get shown
+    struct stat st;
+    struct log_reader lr;
+    if (stat(path, &st) < 0)
+    {
+        perror(path);
+        return 1;
+    }
+    if (log_reader_open(&lr, path, st.st_size))
+        return 1;   // reported already
+
+    struct log_watch lw;
+    if (log_watch_open(&lw, path) < 0)
+    {
+        return 1;
+    }
+
+    ili9341_spi_init(ILI9341_TFTWIDTH, ILI9341_TFTHEIGHT, dc_pin, rst_pin, argv[1]);
+    for (int i = 0; i < 2; i++)
+    {
+        bcm2835_gpio_fsel(cs_pins[i], BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_write(cs_pins[i], HIGH);
+    }
+    uint8_t cs_pin = cs_pins[display];
+
+    // reset line is shared, so bring up both displays like weather_graph does
+    ili9341_reset();
+    bcm2835_gpio_write(cs_pins[0], LOW);
+    bcm2835_gpio_write(cs_pins[1], LOW);
+    begin();
+    bcm2835_gpio_write(cs_pins[0], HIGH);
+    bcm2835_gpio_write(cs_pins[1], HIGH);
+
+    // no SA_RESTART, the blocking poll has to return on a signal
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    char status[64];
+    bcm2835_gpio_write(cs_pin, LOW);
+    console_init(&con, 1, 1, 1, ILI9341_GREEN, ILI9341_BLACK);
+    console_header(&con, 0, path);
+    bcm2835_gpio_write(cs_pin, HIGH);
+
+    while (!stop)
+    {
+        struct pollfd pfd = { .fd = lw.fd, .events = POLLIN };
+        if (poll(&pfd, 1, -1) < 0)
+        {
+            if (errno != EINTR)
+                perror("poll");
+            continue;
+        }
+        // the reader switches over to a rotated log on its own
+        if (!log_watch_read(&lw))
+            continue;
+
+        bcm2835_gpio_write(cs_pin, LOW);
+        if (log_reader_poll(&lr, print_line, NULL) > 0)
+        {
+            snprintf(status, sizeof status, "%llu lines", (unsigned long long) line_count);
+            console_footer(&con, 0, status);
+        }
+        bcm2835_gpio_write(cs_pin, HIGH);
+    }
+
+    log_watch_close(&lw);
+    log_reader_close(&lr);
+    for (int i = 0; i < 2; i++)
+        bcm2835_gpio_fsel(cs_pins[i], BCM2835_GPIO_FSEL_INPT);
+    ili9341_spi_close();
+    return 0;
+}
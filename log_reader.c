@@ -0,0 +1,539 @@
+/*  incremental reader for an append-only text log, see log_reader.h */
+
+#define _GNU_SOURCE // memrchr
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+
+#include "log_reader.h"
+
+#define READ_CHUNK 4096
+#define BULK_MAX_THREADS 4
+#define BULK_SEGMENT (16 << 20)     // mapped at once, bounds the records in memory
+#define BULK_MIN_CHUNK (64 << 10)   // smaller backlogs are not worth a thread
+
+static int reopen(struct log_reader *lr)
+{
+    struct stat st;
+
+    if (lr->fd >= 0)
+        close(lr->fd);
+    lr->fd = open(lr->path, O_RDONLY | O_CLOEXEC);
+    if (lr->fd < 0 || fstat(lr->fd, &st) < 0)
+    {
+        perror(lr->path);
+        return 1;
+    }
+    lr->dev = st.st_dev;
+    lr->ino = st.st_ino;
+    return 0;
+}
+
+// start over at the beginning of the file
+static void rewind_reader(struct log_reader *lr)
+{
+    lr->pos = 0;
+    lr->line_len = 0;
+    lr->line_overflow = 0;
+}
+
+// open path and start reading at offset pos
+int log_reader_open(struct log_reader *lr, const char *path, uint64_t pos)
+{
+    memset(lr, 0, sizeof *lr);
+    lr->path = path;
+    lr->fd = -1;
+    lr->pos = pos;
+    return reopen(lr);
+}
+
+// split buf into lines, the last incomplete one stays in lr->line
+static int feed(struct log_reader *lr, const char *buf, size_t len,
+                log_line_cb cb, void *arg)
+{
+    int lines = 0;
+
+    while (len)
+    {
+        const char *nl = memchr(buf, '\n', len);
+        size_t n = nl ? (size_t)(nl - buf) + 1 : len;
+
+        if (lr->line_len + n > LOG_LINE_MAX)
+            lr->line_overflow = 1;
+        else
+            memcpy(lr->line + lr->line_len, buf, n);
+        lr->line_len += n;
+
+        if (nl)
+        {
+            if (lr->line_overflow)
+            {
+                fprintf(stderr, "%s: skipping line of %zu bytes at offset %llu\n",
+                        lr->path, lr->line_len, (unsigned long long)lr->pos);
+            }
+            else
+            {
+                lr->line[lr->line_len] = '\0';
+                cb(lr->line, lr->line_len, arg);
+                lines++;
+            }
+            lr->pos += lr->line_len;
+            lr->line_len = 0;
+            lr->line_overflow = 0;
+        }
+        buf += n;
+        len -= n;
+    }
+    return lines;
+}
+
+// read everything from lr->pos + carried over bytes up to the end of file
+static int drain(struct log_reader *lr, log_line_cb cb, void *arg)
+{
+    char buf[READ_CHUNK];
+    uint64_t off = lr->pos + lr->line_len;
+    int lines = 0;
+    ssize_t n;
+
+    while ((n = pread(lr->fd, buf, sizeof buf, off)) > 0)
+    {
+        lines += feed(lr, buf, n, cb, arg);
+        off += n;
+    }
+    if (n < 0)
+    {
+        perror("pread");
+        return -1;
+    }
+    return lines;
+}
+
+// hand every line appended since the last call to cb
+int log_reader_poll(struct log_reader *lr, log_line_cb cb, void *arg)
+{
+    struct stat st;
+    int lines = 0;
+
+    if (lr->fd < 0 && reopen(lr))
+        return -1;
+
+    // rotated: finish the old file, then continue with the new one.
+    // if the path is missing right now keep reading the old file
+    if (!stat(lr->path, &st) && (st.st_ino != lr->ino || st.st_dev != lr->dev))
+    {
+        lines = drain(lr, cb, arg);
+        if (lines < 0)
+            lines = 0;
+        rewind_reader(lr);
+        if (reopen(lr))
+            return -1;
+    }
+
+    if (fstat(lr->fd, &st) < 0)
+    {
+        perror("fstat");
+        return -1;
+    }
+    // truncated: whatever we had is gone
+    if (st.st_size < lr->pos + lr->line_len)
+        rewind_reader(lr);
+
+    int n = drain(lr, cb, arg);
+    return n < 0 ? -1 : lines + n;
+}
+
+// log_line_cb adapter for the records of log_reader_bulk()
+struct record_args {
+    log_parse_cb parse;
+    log_record_cb cb;
+    void *arg;
+    void *rec;
+};
+
+static void record_line(char *line, size_t len, void *arg)
+{
+    struct record_args *ra = arg;
+    if (!ra->parse(line, len, ra->rec))
+        ra->cb(ra->rec, ra->arg);
+}
+
+// line by line fallback of log_reader_bulk()
+static int poll_records(struct log_reader *lr, size_t rec_size, log_parse_cb parse,
+                        log_record_cb cb, void *arg)
+{
+    struct record_args ra = { parse, cb, arg, malloc(rec_size) };
+    if (!ra.rec)
+    {
+        perror("malloc");
+        return -1;
+    }
+    int lines = log_reader_poll(lr, record_line, &ra);
+    free(ra.rec);
+    return lines;
+}
+
+// complete lines start .. end and the records parsed from them
+struct bulk_chunk {
+    const struct log_reader *lr;
+    const char *start, *end;
+    size_t rec_size;
+    log_parse_cb parse;
+    char *recs;
+    size_t n_recs, cap_recs;
+    int lines;
+};
+
+static void *parse_chunk(void *arg)
+{
+    struct bulk_chunk *c = arg;
+    const char *p = c->start;
+
+    while (p < c->end)
+    {
+        // memchr is the vectorized part, the line is only touched by parse
+        const char *nl = memchr(p, '\n', c->end - p);
+        size_t len = nl + 1 - p;
+
+        if (len > LOG_LINE_MAX)
+        {
+            fprintf(stderr, "%s: skipping line of %zu bytes\n", c->lr->path, len);
+            p = nl + 1;
+            continue;
+        }
+        if (c->n_recs == c->cap_recs)
+        {
+            // lines in our logs are ~40 bytes, start with a good guess
+            c->cap_recs = c->cap_recs ? c->cap_recs * 2 : (c->end - c->start) / 32 + 16;
+            c->recs = realloc(c->recs, c->cap_recs * c->rec_size);
+            if (!c->recs)
+            {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        if (!c->parse(p, len, c->recs + c->n_recs * c->rec_size))
+            c->n_recs++;
+        c->lines++;
+        p = nl + 1;
+    }
+    return NULL;
+}
+
+// parse the complete lines start .. end on up to BULK_MAX_THREADS cores
+static int bulk_segment(const struct log_reader *lr, const char *start, const char *end,
+                        size_t rec_size, log_parse_cb parse, log_record_cb cb, void *arg)
+{
+    struct bulk_chunk chunks[BULK_MAX_THREADS];
+    pthread_t threads[BULK_MAX_THREADS];
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t len = end - start;
+    int lines = 0;
+
+    if (n > BULK_MAX_THREADS)
+        n = BULK_MAX_THREADS;
+    if (n > (long)(len / BULK_MIN_CHUNK))
+        n = len / BULK_MIN_CHUNK;
+    if (n < 1)
+        n = 1;
+
+    // cut at the first '\n' after every n-th of the segment, end[-1] is one
+    const char *cut = start;
+    for (long i = 0; i < n; i++)
+    {
+        chunks[i] = (struct bulk_chunk) { .lr = lr, .start = cut, .end = end,
+                                          .rec_size = rec_size, .parse = parse };
+        if (i + 1 < n)
+        {
+            const char *from = start + len * (i + 1) / n;
+            if (from < cut)
+                from = cut;
+            cut = from < end ? (const char *)memchr(from, '\n', end - from) + 1 : end;
+            chunks[i].end = cut;
+        }
+    }
+
+    // chunk 0 on this thread, or all of them if no thread can be started
+    long started = 1;
+    for (; started < n; started++)
+    {
+        if (pthread_create(&threads[started], NULL, parse_chunk, &chunks[started]))
+        {
+            perror("pthread_create");
+            break;
+        }
+    }
+    for (long i = 0; i < n; i++)
+    {
+        if (!i || i >= started)
+            parse_chunk(&chunks[i]);
+    }
+    for (long i = 1; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    // chunks are in file order, so concatenating them keeps the records sorted
+    for (long i = 0; i < n; i++)
+    {
+        for (size_t r = 0; r < chunks[i].n_recs; r++)
+            cb(chunks[i].recs + r * rec_size, arg);
+        lines += chunks[i].lines;
+        free(chunks[i].recs);
+    }
+    return lines;
+}
+
+// like log_reader_poll(), but parses the lines in parallel
+int log_reader_bulk(struct log_reader *lr, size_t rec_size, log_parse_cb parse,
+                    log_record_cb cb, void *arg)
+{
+    struct stat st;
+    long page = sysconf(_SC_PAGESIZE);
+    int lines = 0;
+
+    if (lr->fd < 0 && reopen(lr))
+        return -1;
+
+    // carried over bytes, rotation and truncation are left to the line by
+    // line path, it also picks up the unfinished last line
+    if (lr->line_len ||
+        (!stat(lr->path, &st) && (st.st_ino != lr->ino || st.st_dev != lr->dev)) ||
+        fstat(lr->fd, &st) < 0 || st.st_size < lr->pos)
+    {
+        return poll_records(lr, rec_size, parse, cb, arg);
+    }
+
+    while (st.st_size - lr->pos >= BULK_MIN_CHUNK)
+    {
+        uint64_t map_off = lr->pos - lr->pos % page;
+        size_t map_len = st.st_size - map_off < BULK_SEGMENT ? st.st_size - map_off
+                                                              : BULK_SEGMENT;
+        char *map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, lr->fd, map_off);
+        if (map == MAP_FAILED)
+        {
+            perror("mmap");
+            break;
+        }
+        madvise(map, map_len, MADV_SEQUENTIAL);
+
+        const char *start = map + (lr->pos - map_off);
+        const char *end = memrchr(start, '\n', map + map_len - start);
+        if (end)
+        {
+            lines += bulk_segment(lr, start, end + 1, rec_size, parse, cb, arg);
+            lr->pos += end + 1 - start;
+        }
+        munmap(map, map_len);
+        if (!end)
+            break;  // no '\n' in a whole segment, let the fallback skip it
+    }
+
+    int n = poll_records(lr, rec_size, parse, cb, arg);
+    return n < 0 ? -1 : lines + n;
+}
+
+/* key of the first parseable line starting at or after off
+ * *line_off gets the offset of that line, or of the unfinished last line,
+ * or the file size if there is none. usually costs a single pread
+ */
+static int64_t key_after(struct log_reader *lr, log_key_cb key_cb, uint64_t off,
+                         uint64_t size, uint64_t *line_off)
+{
+    char buf[2 * LOG_LINE_MAX + 1];
+    // a line starts at off if off is 0 or the byte before it is a '\n'
+    uint64_t pos = off ? off - 1 : 0;
+    uint8_t synced = !off;
+
+    while (pos < size)
+    {
+        ssize_t n = pread(lr->fd, buf, sizeof buf - 1, pos);
+        if (n <= 0)
+            break;
+        char *p = buf, *end = buf + n;
+
+        if (!synced)
+        {
+            char *nl = memchr(p, '\n', n);
+            if (!nl)
+            {
+                pos += n;
+                continue;
+            }
+            p = nl + 1;
+            synced = 1;
+        }
+
+        // p is the start of a line
+        char *nl = memchr(p, '\n', end - p);
+        if (!nl)
+        {
+            if (p != buf)
+            {
+                pos += p - buf; // read again starting at the line
+                continue;
+            }
+            if (pos + n >= size)
+            {
+                *line_off = pos; // last line is still being written
+                return -1;
+            }
+            pos += n;   // too long for us, skip it
+            synced = 0;
+            continue;
+        }
+        *nl = '\0';
+        int64_t key = key_cb(p);
+        if (key >= 0)
+        {
+            *line_off = pos + (p - buf);
+            return key;
+        }
+        pos += nl + 1 - buf;    // unparseable, try the next line
+    }
+    *line_off = size;
+    return -1;
+}
+
+// continue reading at the first line with a key >= key
+int64_t log_reader_seek(struct log_reader *lr, log_key_cb key_cb, int64_t key)
+{
+    struct stat st;
+    uint64_t lo = 0, hi, line_off;
+
+    if (fstat(lr->fd, &st) < 0)
+    {
+        perror("fstat");
+        return -1;
+    }
+    // find the smallest offset whose next line has a key >= key,
+    // that is a monotonic predicate as long as the lines are sorted
+    hi = st.st_size;
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        int64_t k = key_after(lr, key_cb, mid, st.st_size, &line_off);
+        if (k < 0 || k >= key)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    key_after(lr, key_cb, lo, st.st_size, &line_off);
+
+    lr->pos = line_off;
+    lr->line_len = 0;
+    lr->line_overflow = 0;
+    return lr->pos;
+}
+
+// key of the last complete line in the file, < 0 if there is none
+int64_t log_reader_last_key(struct log_reader *lr, log_key_cb key_cb)
+{
+    char buf[2 * LOG_LINE_MAX + 1];
+    struct stat st;
+
+    if (fstat(lr->fd, &st) < 0)
+        return -1;
+    uint64_t off = st.st_size > sizeof buf - 1 ? st.st_size - (sizeof buf - 1) : 0;
+    ssize_t n = pread(lr->fd, buf, sizeof buf - 1, off);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+
+    // walk backwards over the complete lines in buf
+    char *end = memrchr(buf, '\n', n);
+    while (end)
+    {
+        *end = '\0';
+        char *start = memrchr(buf, '\n', end - buf);
+        if (!start)
+        {
+            // first line in buf may be cut off unless it starts the file
+            return off ? -1 : key_cb(buf);
+        }
+        int64_t key = key_cb(start + 1);
+        if (key >= 0)
+            return key;
+        end = start;
+    }
+    return -1;
+}
+
+void log_reader_close(struct log_reader *lr)
+{
+    if (lr->fd >= 0)
+        close(lr->fd);
+    lr->fd = -1;
+}
+
+/* watch the directory of the log at path
+ * a watch on the file itself is gone after a rotation, and the new file
+ * may not exist yet when the old one goes away. the directory stays
+ */
+int log_watch_open(struct log_watch *lw, const char *path)
+{
+    char dir[PATH_MAX], base[PATH_MAX];
+
+    snprintf(dir, sizeof dir, "%s", path);
+    snprintf(base, sizeof base, "%s", path);
+    snprintf(lw->name, sizeof lw->name, "%s", basename(base));
+
+    lw->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (lw->fd < 0)
+    {
+        perror("inotify_init1");
+        return -1;
+    }
+    // MODIFY: appended to, CREATE/MOVED_TO: a new log took the name
+    lw->wd = inotify_add_watch(lw->fd, dirname(dir), IN_MODIFY | IN_CREATE | IN_MOVED_TO);
+    if (lw->wd < 0)
+    {
+        perror(path);
+        close(lw->fd);
+        lw->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// drain pending events, returns 1 if the log was written, created or replaced
+int log_watch_read(struct log_watch *lw)
+{
+    char buf[16 * (sizeof (struct inotify_event) + NAME_MAX + 1)]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    int changed = 0;
+
+    while ((len = read(lw->fd, buf, sizeof buf)) > 0)
+    {
+        for (ssize_t i = 0; i < len; )
+        {
+            struct inotify_event *ev = (struct inotify_event*) &buf[i];
+            // lost events, better look
+            if (ev->mask & IN_Q_OVERFLOW)
+                changed = 1;
+            // other files in the directory are none of our business
+            if (ev->len && !strcmp(ev->name, lw->name))
+                changed = 1;
+            i += sizeof (struct inotify_event) + ev->len;
+        }
+    }
+    if (len < 0 && errno != EAGAIN && errno != EINTR)
+        perror("read");
+    return changed;
+}
+
+void log_watch_close(struct log_watch *lw)
+{
+    if (lw->fd < 0)
+        return;
+    inotify_rm_watch(lw->fd, lw->wd);
+    close(lw->fd);
+    lw->fd = -1;
+}
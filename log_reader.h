@@ -0,0 +1,84 @@
+/*  incremental reader for an append-only text log
+ *
+ *  keeps the file open between updates and only reads the bytes that were
+ *  appended since the last call. a line is handed out once its '\n' has
+ *  been written, half written lines are carried over to the next call.
+ *  truncation (size shrinks) and rotation (path points to a new inode) are
+ *  detected and reading starts over at the beginning of the new file.
+ *
+ *  lines have to be sorted by a key (e.g. their timestamp) for
+ *  log_reader_seek() to jump to the first relevant line by bisection.
+ *
+ *  log_reader_bulk() is for big backlogs: it mmaps what was appended,
+ *  splits it into line aligned chunks and parses them into fixed size
+ *  records on every core. the records come out in file order, so they
+ *  stay sorted like the lines were.
+ *
+ *  struct log_watch tells when to poll: it watches the directory of the
+ *  log instead of the file, so it keeps working when the log gets rotated
+ *  and picks it up when it only gets created later.
+ */
+
+#ifndef LOG_READER_H
+#define LOG_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <limits.h>
+
+#define LOG_LINE_MAX 128    // longer lines are skipped
+
+struct log_reader {
+    const char *path;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    uint64_t pos;           // file offset of the first byte not yet consumed
+    char line[LOG_LINE_MAX + 1]; // partial line carried over between calls
+    size_t line_len;
+    uint8_t line_overflow;  // current line is too long and gets skipped
+};
+
+struct log_watch {
+    int fd;                 // non-blocking inotify fd, for poll()/epoll
+    int wd;
+    char name[NAME_MAX + 1]; // of the log in the watched directory
+};
+
+// gets every complete line including the trailing '\n', NUL terminated
+typedef void (*log_line_cb)(char *line, size_t len, void *arg);
+
+// turn a line (including '\n', not NUL terminated) into a record
+// returns 0 if rec got filled. called from several threads at once
+typedef int (*log_parse_cb)(const char *line, size_t len, void *rec);
+// gets the records of log_reader_bulk() in file order
+typedef void (*log_record_cb)(const void *rec, void *arg);
+
+// extract the sort key of a line, < 0 if the line has none
+typedef int64_t (*log_key_cb)(const char *line);
+
+// open path and start reading at offset pos
+// returns 0, or 1 if path can't be opened (reported on stderr)
+int log_reader_open(struct log_reader *lr, const char *path, uint64_t pos);
+// hand every line appended since the last call to cb
+// returns the number of lines or -1 on error
+int log_reader_poll(struct log_reader *lr, log_line_cb cb, void *arg);
+// like log_reader_poll(), but parses the lines in parallel
+// returns the number of lines or -1 on error
+int log_reader_bulk(struct log_reader *lr, size_t rec_size, log_parse_cb parse,
+                    log_record_cb cb, void *arg);
+// continue reading at the first line with a key >= key
+// returns the new offset or -1 on error
+int64_t log_reader_seek(struct log_reader *lr, log_key_cb key_cb, int64_t key);
+// key of the last complete line in the file, < 0 if there is none
+int64_t log_reader_last_key(struct log_reader *lr, log_key_cb key_cb);
+void log_reader_close(struct log_reader *lr);
+
+// watch the directory of the log at path
+int log_watch_open(struct log_watch *lw, const char *path);
+// drain pending events, returns 1 if the log was written, created or replaced
+int log_watch_read(struct log_watch *lw);
+void log_watch_close(struct log_watch *lw);
+
+#endif // LOG_READER_H
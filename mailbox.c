@@ -0,0 +1,77 @@
+/*  latest-wins mailbox, see mailbox.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mailbox.h"
+
+int mailbox_init(struct mailbox *mb, size_t size)
+{
+    mb->slot = malloc(size);
+    if (!mb->slot)
+    {
+        perror("malloc");
+        return -1;
+    }
+    pthread_mutex_init(&mb->lock, NULL);
+    pthread_cond_init(&mb->posted, NULL);
+    mb->size = size;
+    mb->pending = 0;
+    mb->closed = 0;
+    mb->dropped = 0;
+    return 0;
+}
+
+// replace the pending message with a copy of msg
+void mailbox_post(struct mailbox *mb, const void *msg)
+{
+    pthread_mutex_lock(&mb->lock);
+    if (mb->pending)
+        mb->dropped++;
+    memcpy(mb->slot, msg, mb->size);
+    mb->pending = 1;
+    pthread_cond_signal(&mb->posted);
+    pthread_mutex_unlock(&mb->lock);
+}
+
+// wait for a message and copy it to msg
+int mailbox_take(struct mailbox *mb, void *msg)
+{
+    pthread_mutex_lock(&mb->lock);
+    while (!mb->pending && !mb->closed)
+        pthread_cond_wait(&mb->posted, &mb->lock);
+    if (!mb->pending)
+    {
+        pthread_mutex_unlock(&mb->lock);
+        return -1;
+    }
+    memcpy(msg, mb->slot, mb->size);
+    mb->pending = 0;
+    pthread_mutex_unlock(&mb->lock);
+    return 0;
+}
+
+void mailbox_close(struct mailbox *mb)
+{
+    pthread_mutex_lock(&mb->lock);
+    mb->closed = 1;
+    pthread_cond_broadcast(&mb->posted);
+    pthread_mutex_unlock(&mb->lock);
+}
+
+uint64_t mailbox_dropped(struct mailbox *mb)
+{
+    pthread_mutex_lock(&mb->lock);
+    uint64_t dropped = mb->dropped;
+    pthread_mutex_unlock(&mb->lock);
+    return dropped;
+}
+
+void mailbox_free(struct mailbox *mb)
+{
+    free(mb->slot);
+    mb->slot = NULL;
+    pthread_mutex_destroy(&mb->lock);
+    pthread_cond_destroy(&mb->posted);
+}
@@ -0,0 +1,39 @@
+/*  latest-wins mailbox between a producer and one consumer thread
+ *
+ *  holds at most one pending message of a fixed size. posting while the
+ *  previous message was not taken yet replaces it and counts it as
+ *  dropped, so the consumer always gets the newest state and never works
+ *  through a backlog of stale ones. the producer never blocks on the
+ *  consumer.
+ */
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+struct mailbox {
+    pthread_mutex_t lock;
+    pthread_cond_t posted;
+    void *slot;             // pending message
+    size_t size;
+    uint8_t pending;
+    uint8_t closed;
+    uint64_t dropped;       // messages replaced before they were taken
+};
+
+// set up a mailbox for messages of size bytes, returns -1 on error
+int mailbox_init(struct mailbox *mb, size_t size);
+// replace the pending message with a copy of msg
+void mailbox_post(struct mailbox *mb, const void *msg);
+// wait for a message and copy it to msg
+// returns -1 once the mailbox is closed and nothing is pending
+int mailbox_take(struct mailbox *mb, void *msg);
+// wake up the consumer, mailbox_take() fails after the last message
+void mailbox_close(struct mailbox *mb);
+uint64_t mailbox_dropped(struct mailbox *mb);
+void mailbox_free(struct mailbox *mb);
+
+#endif // MAILBOX_H
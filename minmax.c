@@ -0,0 +1,55 @@
+/*  sliding window minimum and maximum, see minmax.h */
+
+#include "minmax.h"
+
+// forget all values and cover the last window values from now on
+void minmax_init(struct minmax_window *w, uint16_t window)
+{
+    if (window > MINMAX_MAX_WINDOW)
+        window = MINMAX_MAX_WINDOW;
+    w->window = window;
+    w->seq = 0;
+    w->min.head = w->min.len = 0;
+    w->max.head = w->max.len = 0;
+}
+
+static struct minmax_entry *tail(struct minmax_deque *d)
+{
+    return &d->e[(d->head + d->len - 1) % MINMAX_MAX_WINDOW];
+}
+
+/* drop the candidate that left the window from the head (only one can
+ * leave per push) and all candidates that val beats from the tail,
+ * they can never become min/max again. then append val
+ */
+static void push(struct minmax_deque *d, uint32_t seq, int32_t val,
+                 uint16_t window, uint8_t want_min)
+{
+    if (d->len && seq - d->e[d->head].seq >= window)
+    {
+        d->head = (d->head + 1) % MINMAX_MAX_WINDOW;
+        d->len--;
+    }
+    while (d->len && (want_min ? tail(d)->val >= val : tail(d)->val <= val))
+        d->len--;
+    d->len++;
+    *tail(d) = (struct minmax_entry) { seq, val };
+}
+
+// add a value, the one pushed window values ago drops out
+void minmax_push(struct minmax_window *w, int32_t val)
+{
+    push(&w->min, w->seq, val, w->window, 1);
+    push(&w->max, w->seq, val, w->window, 0);
+    w->seq++;
+}
+
+int32_t minmax_min(const struct minmax_window *w)
+{
+    return w->min.e[w->min.head].val;
+}
+
+int32_t minmax_max(const struct minmax_window *w)
+{
+    return w->max.e[w->max.head].val;
+}
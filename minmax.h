@@ -0,0 +1,40 @@
+/*  sliding window minimum and maximum
+ *
+ *  keeps a monotonic deque of candidates for the minimum and one for the
+ *  maximum of the last `window` values pushed. pushing is amortized O(1),
+ *  asking for min or max is O(1), no matter how wide the window is.
+ */
+
+#ifndef MINMAX_H
+#define MINMAX_H
+
+#include <stdint.h>
+
+#define MINMAX_MAX_WINDOW 320   // widest window supported, one per x axis pixel
+
+struct minmax_entry {
+    uint32_t seq;   // position of the value in the stream of pushed values
+    int32_t val;
+};
+
+struct minmax_deque {
+    uint16_t head, len;
+    struct minmax_entry e[MINMAX_MAX_WINDOW];
+};
+
+struct minmax_window {
+    uint16_t window;    // 0: not set up yet
+    uint32_t seq;       // sequence number of the next value
+    struct minmax_deque min;    // values increase from head to tail
+    struct minmax_deque max;    // values decrease from head to tail
+};
+
+// forget all values and cover the last window values from now on
+void minmax_init(struct minmax_window *w, uint16_t window);
+// add a value, the one pushed window values ago drops out
+void minmax_push(struct minmax_window *w, int32_t val);
+// min/max of the values in the window, undefined if nothing was pushed
+int32_t minmax_min(const struct minmax_window *w);
+int32_t minmax_max(const struct minmax_window *w);
+
+#endif // MINMAX_H
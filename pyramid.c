@@ -0,0 +1,96 @@
+/*  multi-resolution time series, see pyramid.h */
+
+#include <string.h>
+
+#include "pyramid.h"
+
+// bucket width of each level in seconds
+static const uint32_t widths[PYRAMID_LEVELS] = { 15 * 60, 60 * 60, 6 * 60 * 60, 24 * 60 * 60 };
+
+static struct pyramid_bucket *bucket(struct pyramid *p, uint8_t level, uint16_t i)
+{
+    return &p->agg[level][(p->rings[level].head + i) % PYRAMID_LEN];
+}
+
+void pyramid_init(struct pyramid *p)
+{
+    memset(p->rings, 0, sizeof p->rings);
+}
+
+// start a new bucket at the end of a level, dropping the oldest if full
+static struct pyramid_bucket *push(struct pyramid *p, uint8_t level, int64_t start)
+{
+    struct pyramid_ring *r = &p->rings[level];
+    struct pyramid_bucket *b;
+
+    if (r->count == PYRAMID_LEN)
+        r->head = (r->head + 1) % PYRAMID_LEN;
+    else
+        r->count++;
+    b = bucket(p, level, r->count - 1);
+    b->start = start;
+    b->count = 0;
+    return b;
+}
+
+// add a sample taken at time t (seconds), samples have to come in in order
+void pyramid_add(struct pyramid *p, int64_t t, const int32_t *vals)
+{
+    for (uint8_t level = 0; level < PYRAMID_LEVELS; level++)
+    {
+        struct pyramid_ring *r = &p->rings[level];
+        int64_t start = t - t % widths[level];
+        struct pyramid_bucket *b = r->count ? bucket(p, level, r->count - 1) : NULL;
+
+        if (!b || b->start != start)
+            b = push(p, level, start);
+
+        for (uint8_t ch = 0; ch < PYRAMID_CHANNELS; ch++)
+        {
+            if (!b->count || vals[ch] < b->min[ch])
+                b->min[ch] = vals[ch];
+            if (!b->count || vals[ch] > b->max[ch])
+                b->max[ch] = vals[ch];
+            b->sum[ch] = (b->count ? b->sum[ch] : 0) + vals[ch];
+        }
+        b->count++;
+    }
+}
+
+// number of buckets available at level
+uint16_t pyramid_count(const struct pyramid *p, uint8_t level)
+{
+    return p->rings[level].count;
+}
+
+// seconds covered by one bucket of level
+uint32_t pyramid_bucket_width(uint8_t level)
+{
+    return widths[level];
+}
+
+// copy stat of channel ch for the n newest buckets of level to out, oldest first
+uint16_t pyramid_read(const struct pyramid *p, uint8_t level, uint8_t ch,
+                      enum pyramid_stat stat, int32_t *out, uint16_t n)
+{
+    uint16_t count = p->rings[level].count;
+    if (n > count)
+        n = count;
+
+    for (uint16_t i = 0; i < n; i++)
+    {
+        const struct pyramid_bucket *b = bucket((struct pyramid*) p, level, count - n + i);
+        switch (stat)
+        {
+        case PYRAMID_MIN:
+            out[i] = b->min[ch];
+            break;
+        case PYRAMID_MAX:
+            out[i] = b->max[ch];
+            break;
+        default:
+            out[i] = b->sum[ch] / b->count;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,57 @@
+/*  multi-resolution time series
+ *
+ *  keeps per-bucket min/max/avg of the samples at several levels (15 min,
+ *  1 h, 6 h, 1 day). every level is a ringbuffer that gets updated
+ *  incrementally on each append, so a graph can show days or months by
+ *  reading the newest buckets of one level, no matter how many samples
+ *  went into them. the samples themselves are kept by history.h.
+ *
+ *  the struct holds no pointers, so it can be copied into a checkpoint.
+ */
+
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <stdint.h>
+
+#define PYRAMID_CHANNELS 3      // values per sample
+#define PYRAMID_LEVELS 4
+#define PYRAMID_LEN 300         // buckets kept at every level
+
+enum pyramid_stat {
+    PYRAMID_AVG,
+    PYRAMID_MIN,
+    PYRAMID_MAX,
+};
+
+struct pyramid_bucket {
+    int64_t start;  // timestamp (seconds) of the bucket
+    uint32_t count; // samples in the bucket
+    int32_t min[PYRAMID_CHANNELS];
+    int32_t max[PYRAMID_CHANNELS];
+    int64_t sum[PYRAMID_CHANNELS];
+};
+
+struct pyramid_ring {
+    uint16_t head;  // oldest bucket
+    uint16_t count;
+};
+
+struct pyramid {
+    struct pyramid_ring rings[PYRAMID_LEVELS];
+    struct pyramid_bucket agg[PYRAMID_LEVELS][PYRAMID_LEN];
+};
+
+void pyramid_init(struct pyramid *p);
+// add a sample taken at time t (seconds), samples have to come in in order
+void pyramid_add(struct pyramid *p, int64_t t, const int32_t *vals);
+// number of buckets available at level
+uint16_t pyramid_count(const struct pyramid *p, uint8_t level);
+// seconds covered by one bucket of level
+uint32_t pyramid_bucket_width(uint8_t level);
+// copy stat of channel ch for the n newest buckets of level to out, oldest first
+// returns the number of buckets copied, less than n if there aren't enough
+uint16_t pyramid_read(const struct pyramid *p, uint8_t level, uint8_t ch,
+                      enum pyramid_stat stat, int32_t *out, uint16_t n);
+
+#endif // PYRAMID_H
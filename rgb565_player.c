@@ -0,0 +1,206 @@
+/*  play a raw RGB565 animation on one of the displays
+ *
+ *  usage: rgb565_player <spidev> <file> [display 0|1] [loops, 0 = forever]
+ *
+ *  the file is mmap'd and every frame is sent with one address window
+ *  straight from the mapping, so this doubles as a throughput test for the
+ *  spidev path of the driver. frames are paced by a timerfd, if the bus
+ *  can't keep up we skip ahead to the frame that is due instead of lagging
+ *  behind. achieved fps and bus utilization get printed once per second.
+ *
+ *  file layout: struct anim_header, followed by frame_count frames of
+ *  width*height pixels each. pixels are stored in panel order (big endian
+ *  RGB565, y running fastest, see drawRawPixels()) so they need no conversion.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#include <bcm2835.h>
+#include "ili9341_spi.h"
+
+#define ANIM_MAGIC "R565"
+
+// all header fields are little endian (native byte order of the Pi)
+struct anim_header {
+    char magic[4];          // ANIM_MAGIC
+    uint16_t header_size;   // offset of the first frame, allows for growing the header
+    uint16_t fps;           // intended frame rate
+    uint16_t x, y;          // position of the frames on the display
+    uint16_t width, height; // size of one frame in pixels
+    uint32_t frame_count;
+};
+
+static uint8_t dc_pin = RPI_V2_GPIO_P1_22;
+static uint8_t rst_pin = RPI_V2_GPIO_P1_18;
+static uint8_t cs_pins[] = { RPI_V2_GPIO_P1_13, RPI_V2_GPIO_P1_16 };
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// print frame rate and how busy the bus was during the last interval
+//   wire:  time the bytes need on the wire at the configured SPI clock
+//   xfer:  time we actually spent inside the driver sending them
+static void print_stats(const char *what, double elapsed, uint32_t frames,
+                        uint32_t dropped, uint64_t bytes, double xfer_time)
+{
+    double wire_time = bytes * 8.0 / ILI9341_SPI_SPEED_HZ;
+    printf("%s: %.1f fps, %u dropped, %.1f MB/s, bus util wire %.0f%% xfer %.0f%%\n",
+            what, frames / elapsed, dropped, bytes / elapsed / 1e6,
+            100.0 * wire_time / elapsed, 100.0 * xfer_time / elapsed);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s <spidev> <file> [display 0|1] [loops]\n", argv[0]);
+        return 1;
+    }
+    int display = argc > 3 ? atoi(argv[3]) & 1 : 0;
+    int loops = argc > 4 ? atoi(argv[4]) : 1;
+
+    int fd_anim = open(argv[2], O_RDONLY);
+    if (fd_anim < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    struct stat st;
+    fstat(fd_anim, &st);
+    if (st.st_size < sizeof (struct anim_header))
+    {
+        fprintf(stderr, "%s: file too short\n", argv[2]);
+        return 1;
+    }
+
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd_anim, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    // frames are read front to back exactly once per loop
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    struct anim_header hdr;
+    memcpy(&hdr, map, sizeof hdr);
+    uint32_t frame_bytes = (uint32_t)hdr.width * hdr.height * 2;
+    if (memcmp(hdr.magic, ANIM_MAGIC, 4) || hdr.header_size < sizeof hdr ||
+        !hdr.fps || !hdr.frame_count ||
+        hdr.x + hdr.width > ILI9341_TFTWIDTH || hdr.y + hdr.height > ILI9341_TFTHEIGHT ||
+        hdr.header_size + (uint64_t)frame_bytes * hdr.frame_count > st.st_size)
+    {
+        fprintf(stderr, "%s: bad header or truncated file\n", argv[2]);
+        return 1;
+    }
+    const uint8_t *frames = map + hdr.header_size;
+
+    ili9341_spi_init(ILI9341_TFTWIDTH, ILI9341_TFTHEIGHT, dc_pin, rst_pin, argv[1]);
+    for (int i = 0; i < 2; i++)
+    {
+        bcm2835_gpio_fsel(cs_pins[i], BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_write(cs_pins[i], HIGH);
+    }
+    uint8_t cs_pin = cs_pins[display];
+
+    // reset line is shared, so bring up both displays like weather_graph does
+    ili9341_reset();
+    bcm2835_gpio_write(cs_pins[0], LOW);
+    bcm2835_gpio_write(cs_pins[1], LOW);
+    begin();
+    bcm2835_gpio_write(cs_pins[0], HIGH);
+    bcm2835_gpio_write(cs_pins[1], HIGH);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    int fd_timer = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (fd_timer < 0)
+    {
+        perror("timerfd_create");
+        return 1;
+    }
+    long period_ns = 1000000000L / hdr.fps;
+    struct itimerspec its = {
+        .it_interval = { period_ns / 1000000000L, period_ns % 1000000000L },
+        .it_value = { 0, 1 },   // first frame right away
+    };
+    timerfd_settime(fd_timer, 0, &its, NULL);
+
+    uint64_t total_frames = (uint64_t)hdr.frame_count * loops;
+    uint64_t frame = 0;     // frame that is due according to the timer
+    uint32_t shown = 0, dropped = 0, shown_total = 0, dropped_total = 0;
+    uint64_t bytes_start = ili9341_bus_bytes(), bytes_last = bytes_start;
+    double xfer_time = 0, xfer_total = 0;
+    double t_start = now_sec(), t_last = t_start;
+
+    while (!stop && (!loops || frame < total_frames))
+    {
+        uint64_t expirations;
+        if (read(fd_timer, &expirations, sizeof expirations) != sizeof expirations)
+            continue; // interrupted by a signal
+
+        // more than one expiration means we missed deadlines, skip those frames
+        frame += expirations;
+        dropped += expirations - 1;
+        if (loops && frame > total_frames)
+            break;
+
+        double t0 = now_sec();
+        bcm2835_gpio_write(cs_pin, LOW);
+        drawRawPixels(hdr.x, hdr.y, hdr.width, hdr.height,
+                        frames + (size_t)((frame - 1) % hdr.frame_count) * frame_bytes);
+        bcm2835_gpio_write(cs_pin, HIGH);
+        double t1 = now_sec();
+        xfer_time += t1 - t0;
+        shown++;
+
+        if (t1 - t_last >= 1.0)
+        {
+            uint64_t bytes = ili9341_bus_bytes();
+            print_stats("1s", t1 - t_last, shown, dropped, bytes - bytes_last, xfer_time);
+            shown_total += shown;
+            dropped_total += dropped;
+            xfer_total += xfer_time;
+            shown = dropped = 0;
+            xfer_time = 0;
+            bytes_last = bytes;
+            t_last = t1;
+        }
+    }
+
+    shown_total += shown;
+    dropped_total += dropped;
+    xfer_total += xfer_time;
+    print_stats("total", now_sec() - t_start, shown_total, dropped_total,
+                ili9341_bus_bytes() - bytes_start, xfer_total);
+
+    close(fd_timer);
+    munmap(map, st.st_size);
+    close(fd_anim);
+    bcm2835_close();
+    return 0;
+}
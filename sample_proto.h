@@ -0,0 +1,34 @@
+/*  records sensor daemons can push to weather_graph
+ *
+ *  weather_graph binds a SOCK_DGRAM unix socket at SAMPLE_SOCKET. every
+ *  datagram carries one or more struct sample_record in native byte order.
+ *  samples go straight into the graphs without a detour through the log,
+ *  which stays optional as the durable copy: a sample that also shows up
+ *  in the log (or arrives late) is dropped, weather_graph only takes
+ *  samples newer than the newest one it has.
+ */
+
+#ifndef SAMPLE_PROTO_H
+#define SAMPLE_PROTO_H
+
+#include <stdint.h>
+
+// the directory is created mode 0700, so only processes running as the
+// same user as weather_graph can push samples
+#define SAMPLE_SOCKET_DIR "/tmp/weather_graph"
+#define SAMPLE_SOCKET SAMPLE_SOCKET_DIR "/samples.sock"
+#define SAMPLE_VERSION 1
+#define SAMPLE_CHANNELS 3       // temperature, pressure, humidity
+#define SAMPLE_MAX_RECORDS 64   // per datagram
+
+struct sample_record {
+    uint8_t version;            // SAMPLE_VERSION
+    uint8_t reserved[3];
+    // fixed point like the log, value * 100 (i.e. 21.37 is 2137)
+    int32_t vals[SAMPLE_CHANNELS];
+    // wall clock time like the timestamps in the log, as seconds:
+    // timegm(localtime(&now)), not time(NULL) unless the Pi runs on UTC
+    int64_t time;
+};
+
+#endif // SAMPLE_PROTO_H
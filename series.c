@@ -0,0 +1,94 @@
+/*  columnar ringbuffer for sensor series, see series.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "series.h"
+
+int series_init(struct series_store *s, uint8_t channels, uint16_t capacity)
+{
+    s->channels = channels;
+    s->capacity = capacity;
+    s->read_index = s->write_index = 0;
+    s->data = calloc((size_t)channels * capacity, sizeof *s->data);
+    if (!s->data)
+    {
+        perror("calloc");
+        return 1;
+    }
+    return 0;
+}
+
+void series_free(struct series_store *s)
+{
+    free(s->data);
+    s->data = NULL;
+}
+
+// append one sample, vals holds one value per channel
+void series_append(struct series_store *s, const int32_t *vals)
+{
+    for (uint8_t ch = 0; ch < s->channels; ch++)
+    {
+        s->data[(uint32_t)ch * s->capacity + s->write_index] = vals[ch];
+    }
+
+    // advance write_index to the now oldest datum
+    s->write_index = (s->write_index + 1) % s->capacity;
+
+    // if write_index has caught up to read_index cause buffer is full
+    // advance read index
+    if (s->write_index == s->read_index)
+    {
+        s->read_index = (s->read_index + 1) % s->capacity;
+    }
+}
+
+// number of samples stored
+uint16_t series_count(const struct series_store *s)
+{
+    return (s->write_index + s->capacity - s->read_index) % s->capacity;
+}
+
+// value of channel ch, i counts from the oldest sample
+int32_t series_get(const struct series_store *s, uint8_t ch, uint16_t i)
+{
+    return s->data[(uint32_t)ch * s->capacity + (s->read_index + i) % s->capacity];
+}
+
+// the newest n samples of channel ch as 1 or 2 spans, oldest first
+uint8_t series_newest(const struct series_store *s, uint8_t ch, uint16_t n,
+                      struct series_span spans[2])
+{
+    const int32_t *col = s->data + (uint32_t)ch * s->capacity;
+    uint16_t count = series_count(s);
+    if (n > count)
+        n = count;
+
+    uint16_t start = (s->write_index + s->capacity - n) % s->capacity;
+    if (start + n <= s->capacity)
+    {
+        spans[0] = (struct series_span) { col + start, n };
+        return 1;
+    }
+    spans[0] = (struct series_span) { col + start, s->capacity - start };
+    spans[1] = (struct series_span) { col, n - spans[0].len };
+    return 2;
+}
+
+// copy the newest n samples of channel ch to out
+uint16_t series_copy_newest(const struct series_store *s, uint8_t ch, uint16_t n,
+                            int32_t *out)
+{
+    struct series_span spans[2];
+    uint8_t n_spans = series_newest(s, ch, n, spans);
+    uint16_t copied = 0;
+
+    for (uint8_t i = 0; i < n_spans; i++)
+    {
+        memcpy(out + copied, spans[i].vals, spans[i].len * sizeof *out);
+        copied += spans[i].len;
+    }
+    return copied;
+}
@@ -0,0 +1,45 @@
+/*  columnar ringbuffer for sensor series
+ *
+ *  stores one contiguous array per channel instead of an array of structs,
+ *  so reading many samples of one channel touches only that channel's
+ *  memory and loops over it can be vectorized. the newest n samples of a
+ *  channel are handed out as at most two contiguous spans (the ringbuffer
+ *  may wrap around once).
+ */
+
+#ifndef SERIES_H
+#define SERIES_H
+
+#include <stdint.h>
+
+struct series_store {
+    uint8_t channels;
+    uint16_t capacity;      // slots per channel, holds capacity - 1 samples
+    uint16_t read_index;    // oldest sample
+    uint16_t write_index;   // next slot to write, unused
+    int32_t *data;          // channel ch starts at data + ch * capacity
+};
+
+struct series_span {
+    const int32_t *vals;
+    uint16_t len;
+};
+
+int series_init(struct series_store *s, uint8_t channels, uint16_t capacity);
+void series_free(struct series_store *s);
+// append one sample, vals holds one value per channel
+// the oldest sample gets dropped if the store is full
+void series_append(struct series_store *s, const int32_t *vals);
+// number of samples stored
+uint16_t series_count(const struct series_store *s);
+// value of channel ch, i counts from the oldest sample
+int32_t series_get(const struct series_store *s, uint8_t ch, uint16_t i);
+// the newest n samples of channel ch (less if there aren't that many),
+// oldest first, as 1 or 2 spans. returns the number of spans
+uint8_t series_newest(const struct series_store *s, uint8_t ch, uint16_t n,
+                      struct series_span spans[2]);
+// copy the newest n samples of channel ch to out, returns how many were copied
+uint16_t series_copy_newest(const struct series_store *s, uint8_t ch, uint16_t n,
+                            int32_t *out);
+
+#endif // SERIES_H
@@ -0,0 +1,273 @@
+/*  offline analyzer for SPI command stream traces (see spi_trace.h)
+ *
+ *  usage: spi_trace <trace> [sites to list, default 20]
+ *
+ *  replays the trace against a virtual GRAM per panel and reports where
+ *  bus bytes go: window setup (CASET/PASET/RAMWR and their arguments)
+ *  versus pixels, overdraw (pixels written more than once within a frame)
+ *  and redundant writes (a pixel set to the color it already has). all of
+ *  it per site, the sites with the most bytes on the bus come first.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ili9341_spi.h"
+#include "spi_trace.h"
+
+#define PIXELS (ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT)
+
+struct site_stats {
+    char name[64];
+    uint64_t bytes;         // everything sent on the bus
+    uint64_t setup_bytes;   // window setup
+    uint64_t windows;       // RAMWR commands
+    uint64_t pixels;        // pixels written
+    uint64_t overdraw;      // pixels written again in the same frame
+    uint64_t redundant;     // pixels written with the color they had
+    uint64_t usec;
+};
+
+// virtual GRAM of one panel
+struct panel {
+    uint16_t gram[PIXELS];
+    uint8_t known[PIXELS];      // pixel got written at least once
+    uint32_t written[PIXELS];   // frame number of the last write
+    uint32_t frame;
+};
+
+static struct site_stats sites[SPI_TRACE_SITES];
+static struct panel panels[SPI_TRACE_PANELS];
+static struct panel *panel = &panels[0];
+static uint64_t frames;
+
+// command state of the display controller
+static uint8_t cmd;
+static uint8_t args[4], n_args;
+static uint16_t x1, x2, y1, y2;     // window, x is the page address
+static uint16_t cur_x, cur_y;
+static int16_t half = -1;           // first byte of a pixel split between records
+
+static void setup_arg(uint8_t b)
+{
+    if (n_args < sizeof args)
+        args[n_args++] = b;
+    if (n_args != 4)
+        return;
+    uint16_t a = args[0] << 8 | args[1], b2 = args[2] << 8 | args[3];
+    if (cmd == ILI9341_PASET)
+    {
+        x1 = a;
+        x2 = b2;
+    }
+    else
+    {
+        y1 = a;
+        y2 = b2;
+    }
+}
+
+// one pixel at the cursor, then advance it like the panel does:
+// y runs fastest, wrapping around within the window
+static void pixel(struct site_stats *s, uint16_t color)
+{
+    if (cur_x < ILI9341_TFTWIDTH && cur_y < ILI9341_TFTHEIGHT)
+    {
+        uint32_t i = cur_y * ILI9341_TFTWIDTH + cur_x;
+        if (panel->known[i] && panel->written[i] == panel->frame)
+            s->overdraw++;
+        if (panel->known[i] && panel->gram[i] == color)
+            s->redundant++;
+        panel->gram[i] = color;
+        panel->known[i] = 1;
+        panel->written[i] = panel->frame;
+    }
+    s->pixels++;
+
+    if (++cur_y > y2)
+    {
+        cur_y = y1;
+        if (++cur_x > x2)
+            cur_x = x1;
+    }
+}
+
+static void command(struct site_stats *s, uint8_t c)
+{
+    cmd = c;
+    n_args = 0;
+    half = -1;
+    s->bytes++;
+    if (c == ILI9341_CASET || c == ILI9341_PASET || c == ILI9341_RAMWR)
+        s->setup_bytes++;
+    if (c == ILI9341_RAMWR)
+    {
+        cur_x = x1;
+        cur_y = y1;
+        s->windows++;
+    }
+}
+
+static void data(struct site_stats *s, const uint8_t *buf, uint32_t len)
+{
+    s->bytes += len;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        if (cmd == ILI9341_CASET || cmd == ILI9341_PASET)
+        {
+            s->setup_bytes++;
+            setup_arg(buf[i]);
+        }
+        else if (cmd == ILI9341_RAMWR)
+        {
+            if (half < 0)
+            {
+                half = buf[i];
+            }
+            else
+            {
+                pixel(s, half << 8 | buf[i]);
+                half = -1;
+            }
+        }
+    }
+}
+
+static void fill(struct site_stats *s, uint16_t color, uint32_t len)
+{
+    s->bytes += (uint64_t)len * 2;
+    if (cmd != ILI9341_RAMWR)
+        return;
+    while (len--)
+        pixel(s, color);
+}
+
+static int by_bytes(const void *a, const void *b)
+{
+    const struct site_stats *sa = a, *sb = b;
+    return sa->bytes < sb->bytes ? 1 : sa->bytes > sb->bytes ? -1 : 0;
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * part / whole : 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct spi_trace_header hdr;
+    struct spi_trace_rec rec;
+    uint8_t *payload = NULL;
+    uint32_t cap = 0;
+    uint64_t records = 0;
+    int top = argc > 2 ? atoi(argv[2]) : 20;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <trace> [sites to list]\n", argv[0]);
+        return 1;
+    }
+    FILE *f = fopen(argv[1], "r");
+    if (!f)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    if (fread(&hdr, sizeof hdr, 1, f) != 1 || hdr.magic != SPI_TRACE_MAGIC ||
+        hdr.version != SPI_TRACE_VERSION)
+    {
+        fprintf(stderr, "%s: not a trace of version %d\n", argv[1], SPI_TRACE_VERSION);
+        return 1;
+    }
+    strcpy(sites[0].name, "(no site)");
+
+    while (fread(&rec, sizeof rec, 1, f) == 1)
+    {
+        struct site_stats *s = &sites[rec.site];
+        uint32_t n = rec.type == SPI_TRACE_DATA || rec.type == SPI_TRACE_SITE ? rec.len : 0;
+        if (n > cap)
+        {
+            cap = n;
+            payload = realloc(payload, cap);
+            if (!payload)
+            {
+                perror("realloc");
+                return 1;
+            }
+        }
+        if (n && fread(payload, 1, n, f) != n)
+        {
+            fprintf(stderr, "%s: truncated\n", argv[1]);
+            break;
+        }
+        records++;
+        // the gap before a frame is idle time, not anybody's cost
+        if (rec.type != SPI_TRACE_FRAME)
+            s->usec += rec.usec;
+
+        switch (rec.type)
+        {
+        case SPI_TRACE_CMD:
+            command(s, rec.arg);
+            break;
+        case SPI_TRACE_DATA:
+            data(s, payload, rec.len);
+            break;
+        case SPI_TRACE_FILL:
+            fill(s, rec.arg, rec.len);
+            break;
+        case SPI_TRACE_SITE:
+            snprintf(sites[rec.arg % SPI_TRACE_SITES].name, sizeof s->name, "%.*s",
+                     (int)rec.len, (char*) payload);
+            break;
+        case SPI_TRACE_FRAME:
+            panel = &panels[rec.arg % SPI_TRACE_PANELS];
+            panel->frame++;
+            frames++;
+            break;
+        default:
+            fprintf(stderr, "%s: unknown record type %u\n", argv[1], rec.type);
+            return 1;
+        }
+    }
+    fclose(f);
+
+    struct site_stats total = { .name = "total" };
+    for (uint16_t i = 0; i < SPI_TRACE_SITES; i++)
+    {
+        total.bytes += sites[i].bytes;
+        total.setup_bytes += sites[i].setup_bytes;
+        total.windows += sites[i].windows;
+        total.pixels += sites[i].pixels;
+        total.overdraw += sites[i].overdraw;
+        total.redundant += sites[i].redundant;
+        total.usec += sites[i].usec;
+    }
+    printf("%llu records, %llu frames, %llu bytes in %.1f ms\n",
+           (unsigned long long)records, (unsigned long long)frames,
+           (unsigned long long)total.bytes, total.usec / 1000.0);
+    printf("window setup: %llu bytes (%.1f%% of the bus) for %llu windows\n",
+           (unsigned long long)total.setup_bytes, percent(total.setup_bytes, total.bytes),
+           (unsigned long long)total.windows);
+    printf("pixels: %llu, overdraw %.1f%%, redundant %.1f%%\n\n",
+           (unsigned long long)total.pixels, percent(total.overdraw, total.pixels),
+           percent(total.redundant, total.pixels));
+
+    qsort(sites, SPI_TRACE_SITES, sizeof *sites, by_bytes);
+    printf("%-24s %10s %6s %7s %8s %7s %9s %9s %9s\n", "site", "bytes", "bus%",
+           "setup%", "windows", "px/win", "overdraw%", "redund%", "ms");
+    for (int i = 0; i < top && i < SPI_TRACE_SITES && sites[i].bytes; i++)
+    {
+        struct site_stats *s = &sites[i];
+        printf("%-24s %10llu %6.1f %7.1f %8llu %7.1f %9.1f %9.1f %9.1f\n", s->name,
+               (unsigned long long)s->bytes, percent(s->bytes, total.bytes),
+               percent(s->setup_bytes, s->bytes), (unsigned long long)s->windows,
+               s->windows ? (double)s->pixels / s->windows : 0,
+               percent(s->overdraw, s->pixels), percent(s->redundant, s->pixels),
+               s->usec / 1000.0);
+    }
+    free(payload);
+    return 0;
+}
@@ -0,0 +1,46 @@
+/*  SPI command stream traces
+ *
+ *  with ILI9341_TRACE=<file> in the environment (or after
+ *  ili9341_trace_open()) the driver records everything it sends: a
+ *  struct spi_trace_header, then one struct spi_trace_rec per command,
+ *  run of data bytes or solid fill, in native byte order. DATA and SITE
+ *  records are followed by len payload bytes.
+ *
+ *  programs can label what they draw with ili9341_trace_site() and mark
+ *  the start of a frame on a panel with ili9341_trace_frame(). the
+ *  spi_trace tool replays a trace against a virtual GRAM per panel and
+ *  reports overdraw, redundant writes and window overhead per site.
+ */
+
+#ifndef SPI_TRACE_H
+#define SPI_TRACE_H
+
+#include <stdint.h>
+
+#define SPI_TRACE_MAGIC 0x52544c49  // "ILTR"
+#define SPI_TRACE_VERSION 1
+#define SPI_TRACE_SITES 256         // site ids per trace, 0 is "no site"
+#define SPI_TRACE_PANELS 2
+
+enum spi_trace_type {
+    SPI_TRACE_CMD = 1,  // arg: command byte (sent with DC low)
+    SPI_TRACE_DATA,     // len bytes sent with DC high follow
+    SPI_TRACE_FILL,     // arg: color, sent len times (2 * len bytes)
+    SPI_TRACE_SITE,     // arg: id of a new site, len bytes of its name follow
+    SPI_TRACE_FRAME,    // arg: panel, a frame on it starts
+};
+
+struct spi_trace_header {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct spi_trace_rec {
+    uint8_t type;       // enum spi_trace_type
+    uint8_t site;       // what was being drawn
+    uint16_t arg;
+    uint32_t len;
+    uint32_t usec;      // since the previous record, covers this transfer
+};
+
+#endif // SPI_TRACE_H
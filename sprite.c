@@ -0,0 +1,153 @@
+/*  sprites, see sprite.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ili9341_spi.h"
+#include "sprite.h"
+
+int sprite_init(struct sprite *s, const uint16_t *pixels, uint16_t width,
+                uint16_t height, uint16_t key)
+{
+    uint32_t n = (uint32_t)width * height;
+
+    s->pixels = pixels;
+    s->width = width;
+    s->height = height;
+    s->key = key;
+    s->visible = 0;
+    // overlapping old and new box fit into twice the size in each direction
+    s->bg = malloc(n * sizeof *s->bg);
+    s->bg_next = malloc(n * sizeof *s->bg_next);
+    s->screen = malloc(4 * n * sizeof *s->screen);
+    s->out = malloc(4 * n * sizeof *s->out);
+    if (!s->bg || !s->bg_next || !s->screen || !s->out)
+    {
+        perror("malloc");
+        sprite_free(s);
+        return -1;
+    }
+    return 0;
+}
+
+// sprite over background bg into a buffer with stride pixels per row
+static void compose(const struct sprite *s, const uint16_t *bg, uint16_t *out,
+                    uint16_t stride)
+{
+    for (uint16_t j = 0; j < s->height; j++)
+    {
+        for (uint16_t i = 0; i < s->width; i++)
+        {
+            uint16_t c = s->pixels[j * s->width + i];
+            out[j * stride + i] = c == s->key ? bg[j * s->width + i] : c;
+        }
+    }
+}
+
+int sprite_show(struct sprite *s, int16_t x, int16_t y)
+{
+    if (readRect(x, y, s->width, s->height, s->bg))
+        return -1;
+    compose(s, s->bg, s->out, s->width);
+    drawRGBBitmap(x, y, s->width, s->height, s->out, s->width);
+    s->x = x;
+    s->y = y;
+    s->visible = 1;
+    return 0;
+}
+
+void sprite_hide(struct sprite *s)
+{
+    if (!s->visible)
+        return;
+    drawRGBBitmap(s->x, s->y, s->width, s->height, s->bg, s->width);
+    s->visible = 0;
+}
+
+int sprite_move(struct sprite *s, int16_t x, int16_t y)
+{
+    if (!s->visible)
+        return sprite_show(s, x, y);
+    if (x == s->x && y == s->y)
+        return 0;
+
+    // boxes don't overlap, the union would mostly be untouched pixels
+    if (x >= s->x + s->width || s->x >= x + s->width ||
+        y >= s->y + s->height || s->y >= y + s->height)
+    {
+        if (readRect(x, y, s->width, s->height, s->bg_next))
+            return -1;
+        sprite_hide(s);
+        uint16_t *tmp = s->bg;
+        s->bg = s->bg_next;
+        s->bg_next = tmp;
+        compose(s, s->bg, s->out, s->width);
+        drawRGBBitmap(x, y, s->width, s->height, s->out, s->width);
+        s->x = x;
+        s->y = y;
+        s->visible = 1;
+        return 0;
+    }
+
+    // union of old and new box
+    int16_t ux = x < s->x ? x : s->x;
+    int16_t uy = y < s->y ? y : s->y;
+    uint16_t uw = s->width + (x > s->x ? x - s->x : s->x - x);
+    uint16_t uh = s->height + (y > s->y ? y - s->y : s->y - y);
+    // offsets of old (o) and new (n) box inside the union
+    uint16_t ox = s->x - ux, oy = s->y - uy, nx = x - ux, ny = y - uy;
+
+    if (readRect(ux, uy, uw, uh, s->screen))
+        return -1;
+
+    // old box gets its background back
+    memcpy(s->out, s->screen, (uint32_t)uw * uh * sizeof *s->out);
+    for (uint16_t j = 0; j < s->height; j++)
+        memcpy(s->out + (oy + j) * uw + ox, s->bg + j * s->width,
+               s->width * sizeof *s->out);
+
+    // background under the new box, where the sprite is now on screen
+    // it is the saved background
+    for (uint16_t j = 0; j < s->height; j++)
+        memcpy(s->bg_next + j * s->width, s->out + (ny + j) * uw + nx,
+               s->width * sizeof *s->bg_next);
+
+    compose(s, s->bg_next, s->out + ny * uw + nx, uw);
+
+    // only send the bounding box of the pixels that change
+    int16_t x1 = uw, y1 = uh, x2 = -1, y2 = -1;
+    for (uint16_t j = 0; j < uh; j++)
+    {
+        for (uint16_t i = 0; i < uw; i++)
+        {
+            if (s->out[j * uw + i] != s->screen[j * uw + i])
+            {
+                if (i < x1) x1 = i;
+                if (i > x2) x2 = i;
+                if (j < y1) y1 = j;
+                if (j > y2) y2 = j;
+            }
+        }
+    }
+    if (x2 >= 0)
+        drawRGBBitmap(ux + x1, uy + y1, x2 - x1 + 1, y2 - y1 + 1,
+                      s->out + y1 * uw + x1, uw);
+
+    uint16_t *tmp = s->bg;
+    s->bg = s->bg_next;
+    s->bg_next = tmp;
+    s->x = x;
+    s->y = y;
+    return 0;
+}
+
+void sprite_free(struct sprite *s)
+{
+    free(s->bg);
+    free(s->bg_next);
+    free(s->screen);
+    free(s->out);
+    s->bg = s->bg_next = s->screen = s->out = NULL;
+}
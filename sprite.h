@@ -0,0 +1,45 @@
+/*  sprites: small RGB565 images moved around on top of whatever is drawn
+ *
+ *  needs the GRAM shadow of the driver (ili9341_shadow()) to be active,
+ *  the background under a sprite is read from it when the sprite shows up
+ *  and kept until the sprite moves on. a move sends a single window
+ *  around the pixels that actually change: the part of the old box that
+ *  gets uncovered and the part of the new box the sprite covers, trimmed
+ *  to the pixels that differ from what is on screen. if old and new box
+ *  don't overlap the two boxes are sent on their own instead, one window
+ *  spanning the gap would cost more.
+ *
+ *  pixels of the key color are transparent.
+ *  sprites must not overlap each other and have to stay fully on screen.
+ *  chip select has to be handled by the caller.
+ */
+
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include <stdint.h>
+
+struct sprite {
+    const uint16_t *pixels; // row-major, width x height
+    uint16_t width, height;
+    uint16_t key;           // transparent color
+    int16_t x, y;
+    uint8_t visible;
+    uint16_t *bg;           // background under the sprite
+    uint16_t *bg_next;      // background under the new position while moving
+    uint16_t *screen;       // union of old and new box, as on screen
+    uint16_t *out;          // union of old and new box, as it should be
+};
+
+// set up a sprite for pixels, returns -1 on error
+int sprite_init(struct sprite *s, const uint16_t *pixels, uint16_t width,
+                uint16_t height, uint16_t key);
+// save the background at x, y and draw the sprite there
+int sprite_show(struct sprite *s, int16_t x, int16_t y);
+// move a visible sprite to x, y
+int sprite_move(struct sprite *s, int16_t x, int16_t y);
+// draw the saved background back
+void sprite_hide(struct sprite *s);
+void sprite_free(struct sprite *s);
+
+#endif // SPRITE_H
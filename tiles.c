@@ -0,0 +1,310 @@
+/*  tiled rendering mode, see tiles.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ili9341_spi.h"
+#include "glcdfont.h"
+#include "tiles.h"
+
+#define MAX_TILES ((ILI9341_TFTWIDTH / TILE_SIZE + 1) * (ILI9341_TFTWIDTH / TILE_SIZE + 1))
+
+enum tile_cmd_type {
+    CMD_RECT,
+    CMD_CHAR,
+    CMD_BITMAP,
+};
+
+struct tile_cmd {
+    uint8_t type;
+    int16_t x, y;
+    uint16_t w, h;      // bounding box
+    uint16_t color, bg;
+    unsigned char c;
+    uint8_t size_x, size_y;
+    uint16_t *pixels;   // copy of a bitmap, w x h row-major
+};
+
+// recorded frame
+static uint16_t width, height, tiles_x, tiles_y;
+static uint16_t background;
+static struct tile_cmd *cmds;
+static uint32_t n_cmds, cap_cmds;
+// per tile the indices of the commands touching it, in drawing order
+static uint32_t *bins[MAX_TILES];
+static uint32_t bin_len[MAX_TILES], bin_cap[MAX_TILES];
+
+// job queue shared with the workers while tiles_end() runs
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t slot_free = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t tile_done = PTHREAD_COND_INITIALIZER;
+static uint16_t dirty[MAX_TILES], n_dirty;
+static uint16_t next_job, jobs_sent;
+static int32_t slot_job[TILE_SLOTS];    // job rendered into the slot, -1 if none
+// tile buffers, already in panel order (big endian, y running fastest)
+static uint8_t slots[TILE_SLOTS][TILE_SIZE * TILE_SIZE * 2];
+
+static void record_rect(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t color);
+static void record_char(int16_t x, int16_t y, unsigned char c, uint16_t color,
+                        uint16_t bg, uint8_t size_x, uint8_t size_y);
+static void record_bitmap(int16_t x, int16_t y, uint16_t w, uint16_t h,
+                          const uint16_t *bitmap, uint16_t stride);
+
+static const struct ili9341_recorder recorder = {
+    .rect = record_rect,
+    .chr = record_char,
+    .bitmap = record_bitmap,
+};
+
+// start recording a frame for a screen of width x height
+void tiles_begin(uint16_t w, uint16_t h, uint16_t bg)
+{
+    width = w;
+    height = h;
+    tiles_x = (w + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (h + TILE_SIZE - 1) / TILE_SIZE;
+    background = bg;
+    n_cmds = 0;
+    memset(bin_len, 0, sizeof bin_len);
+    ili9341_record(&recorder);
+}
+
+// store cmd and add it to the bin of every tile its bounding box touches
+static void record(struct tile_cmd cmd)
+{
+    // clip to the screen, raster() clips to the tile again
+    int32_t x1 = cmd.x, y1 = cmd.y, x2 = cmd.x + cmd.w, y2 = cmd.y + cmd.h;
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 > width) x2 = width;
+    if (y2 > height) y2 = height;
+    if (x1 >= x2 || y1 >= y2)
+    {
+        free(cmd.pixels);
+        return;
+    }
+
+    if (n_cmds == cap_cmds)
+    {
+        cap_cmds = cap_cmds ? cap_cmds * 2 : 64;
+        cmds = realloc(cmds, cap_cmds * sizeof *cmds);
+        if (!cmds)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    cmds[n_cmds] = cmd;
+
+    for (uint16_t ty = y1 / TILE_SIZE; ty <= (y2 - 1) / TILE_SIZE; ty++)
+    {
+        for (uint16_t tx = x1 / TILE_SIZE; tx <= (x2 - 1) / TILE_SIZE; tx++)
+        {
+            uint16_t t = ty * tiles_x + tx;
+            if (bin_len[t] == bin_cap[t])
+            {
+                bin_cap[t] = bin_cap[t] ? bin_cap[t] * 2 : 8;
+                bins[t] = realloc(bins[t], bin_cap[t] * sizeof *bins[t]);
+                if (!bins[t])
+                {
+                    perror("realloc");
+                    exit(1);
+                }
+            }
+            bins[t][bin_len[t]++] = n_cmds;
+        }
+    }
+    n_cmds++;
+}
+
+static void record_rect(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t color)
+{
+    record((struct tile_cmd) { .type = CMD_RECT, .x = x, .y = y, .w = w, .h = h,
+                               .color = color });
+}
+
+static void record_char(int16_t x, int16_t y, unsigned char c, uint16_t color,
+                        uint16_t bg, uint8_t size_x, uint8_t size_y)
+{
+    record((struct tile_cmd) { .type = CMD_CHAR, .x = x, .y = y,
+                               .w = 6 * size_x, .h = 8 * size_y,
+                               .color = color, .bg = bg, .c = c,
+                               .size_x = size_x, .size_y = size_y });
+}
+
+// the caller may reuse bitmap right away, so keep a copy until tiles_end()
+static void record_bitmap(int16_t x, int16_t y, uint16_t w, uint16_t h,
+                          const uint16_t *bitmap, uint16_t stride)
+{
+    uint16_t *pixels = malloc((uint32_t)w * h * sizeof *pixels);
+    if (!pixels)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    for (uint16_t j = 0; j < h; j++)
+        memcpy(pixels + (uint32_t)j * w, bitmap + (uint32_t)j * stride,
+               w * sizeof *pixels);
+    record((struct tile_cmd) { .type = CMD_BITMAP, .x = x, .y = y, .w = w, .h = h,
+                               .pixels = pixels });
+}
+
+// paint one command into a row-major tile buffer at screen position tx, ty
+static void raster(const struct tile_cmd *cmd, uint16_t *pix, uint16_t tx, uint16_t ty,
+                   uint16_t tw, uint16_t th)
+{
+    // intersection of command and tile, in screen coordinates
+    int16_t x1 = cmd->x > tx ? cmd->x : tx;
+    int16_t y1 = cmd->y > ty ? cmd->y : ty;
+    int16_t x2 = cmd->x + cmd->w < tx + tw ? cmd->x + cmd->w : tx + tw;
+    int16_t y2 = cmd->y + cmd->h < ty + th ? cmd->y + cmd->h : ty + th;
+
+    for (int16_t y = y1; y < y2; y++)
+    {
+        uint16_t *row = pix + (y - ty) * TILE_SIZE - tx;
+        for (int16_t x = x1; x < x2; x++)
+        {
+            switch (cmd->type)
+            {
+            case CMD_RECT:
+                row[x] = cmd->color;
+                break;
+            case CMD_BITMAP:
+                row[x] = cmd->pixels[(uint32_t)(y - cmd->y) * cmd->w + x - cmd->x];
+                break;
+            case CMD_CHAR:
+            {
+                // like drawChar(): bit 0 of a font column is the bottom row
+                uint8_t i = (x - cmd->x) / cmd->size_x, j = (y - cmd->y) / cmd->size_y;
+                uint8_t set = i < 5 && (font[cmd->c * 5 + i] >> (7 - j)) & 1;
+                if (set)
+                    row[x] = cmd->color;
+                else if (cmd->bg != cmd->color)
+                    row[x] = cmd->bg;   // transparent otherwise
+                break;
+            }
+            }
+        }
+    }
+}
+
+// rasterize dirty tile number job into its slot
+static void render_job(uint16_t job)
+{
+    uint16_t pix[TILE_SIZE * TILE_SIZE];
+    uint16_t t = dirty[job];
+    uint16_t tx = t % tiles_x * TILE_SIZE, ty = t / tiles_x * TILE_SIZE;
+    uint16_t tw = width - tx < TILE_SIZE ? width - tx : TILE_SIZE;
+    uint16_t th = height - ty < TILE_SIZE ? height - ty : TILE_SIZE;
+
+    for (uint16_t i = 0; i < TILE_SIZE * TILE_SIZE; i++)
+        pix[i] = background;
+    for (uint32_t k = 0; k < bin_len[t]; k++)
+        raster(&cmds[bins[t][k]], pix, tx, ty, tw, th);
+
+    // convert to panel order while we are on a worker anyway
+    uint8_t *out = slots[job % TILE_SLOTS];
+    for (uint16_t i = 0; i < tw; i++)
+    {
+        for (uint16_t j = 0; j < th; j++)
+        {
+            uint16_t color = pix[j * TILE_SIZE + i];
+            *out++ = color >> 8;
+            *out++ = color;
+        }
+    }
+}
+
+static void send_job(uint16_t job)
+{
+    uint16_t t = dirty[job];
+    uint16_t tx = t % tiles_x * TILE_SIZE, ty = t / tiles_x * TILE_SIZE;
+
+    drawRawPixels(tx, ty, width - tx < TILE_SIZE ? width - tx : TILE_SIZE,
+                  height - ty < TILE_SIZE ? height - ty : TILE_SIZE,
+                  slots[job % TILE_SLOTS]);
+}
+
+static void *worker(void *arg)
+{
+    pthread_mutex_lock(&lock);
+    while (next_job < n_dirty)
+    {
+        uint16_t job = next_job++;
+        // wait until the tile that used this slot before has been sent
+        while (job - jobs_sent >= TILE_SLOTS)
+            pthread_cond_wait(&slot_free, &lock);
+        pthread_mutex_unlock(&lock);
+
+        render_job(job);
+
+        pthread_mutex_lock(&lock);
+        slot_job[job % TILE_SLOTS] = job;
+        pthread_cond_broadcast(&tile_done);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// rasterize dirty tiles in parallel and send them, returns the number sent
+uint16_t tiles_end()
+{
+    pthread_t threads[TILE_MAX_THREADS];
+    ili9341_record(NULL);
+    long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads < 1)
+        n_threads = 1;
+    if (n_threads > TILE_MAX_THREADS)
+        n_threads = TILE_MAX_THREADS;
+
+    n_dirty = 0;
+    for (uint16_t t = 0; t < tiles_x * tiles_y; t++)
+    {
+        if (bin_len[t])
+            dirty[n_dirty++] = t;
+    }
+    next_job = jobs_sent = 0;
+    for (uint8_t i = 0; i < TILE_SLOTS; i++)
+        slot_job[i] = -1;
+
+    for (long i = 0; i < n_threads; i++)
+    {
+        if (pthread_create(&threads[i], NULL, worker, NULL))
+        {
+            perror("pthread_create");
+            n_threads = i;
+            break;
+        }
+    }
+
+    // send tiles in order as soon as they are finished
+    for (uint16_t job = 0; job < n_dirty; job++)
+    {
+        if (!n_threads)
+        {
+            render_job(job);    // no workers, do it ourselves
+        }
+        pthread_mutex_lock(&lock);
+        while (n_threads && slot_job[job % TILE_SLOTS] != job)
+            pthread_cond_wait(&tile_done, &lock);
+        pthread_mutex_unlock(&lock);
+
+        send_job(job);
+
+        pthread_mutex_lock(&lock);
+        jobs_sent = job + 1;
+        pthread_cond_broadcast(&slot_free);
+        pthread_mutex_unlock(&lock);
+    }
+
+    for (long i = 0; i < n_threads; i++)
+        pthread_join(threads[i], NULL);
+    for (uint32_t i = 0; i < n_cmds; i++)
+        free(cmds[i].pixels);
+    n_cmds = 0;
+    return n_dirty;
+}
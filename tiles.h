@@ -0,0 +1,35 @@
+/*  tiled rendering mode
+ *
+ *  the screen is split into TILE_SIZE x TILE_SIZE tiles. between
+ *  tiles_begin() and tiles_end() the drawing functions of ili9341_spi
+ *  (fillRect(), drawChar(), drawRGBBitmap(), drawColumns(), ...) are only
+ *  recorded (see ili9341_record()) and binned into every tile they touch.
+ *  tiles_end() lets one worker thread per core rasterize the dirty tiles
+ *  (those with commands) into small tile buffers and sends the finished
+ *  tiles to the display in order, each pixel exactly once.
+ *
+ *  memory is bounded by the tiles in flight instead of a full framebuffer,
+ *  rasterization scales with the number of cores while the main thread
+ *  keeps the bus busy.
+ *
+ *  a dirty tile starts out as the background color given to tiles_begin(),
+ *  tiles without commands are left alone on the display.
+ *  chip select has to be handled by the caller around tiles_end(), the
+ *  tiles go through drawRawPixels() and thus into the shadow if one is set.
+ */
+
+#ifndef TILES_H
+#define TILES_H
+
+#include <stdint.h>
+
+#define TILE_SIZE 32
+#define TILE_MAX_THREADS 4
+#define TILE_SLOTS (2 * TILE_MAX_THREADS)   // tile buffers in flight
+
+// start recording a frame for a screen of width x height
+void tiles_begin(uint16_t width, uint16_t height, uint16_t bg);
+// rasterize dirty tiles in parallel and send them, returns the number sent
+uint16_t tiles_end();
+
+#endif // TILES_H
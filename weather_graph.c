@@ -1,5 +1,6 @@
 /* TODO: try to use hardware chip selects */
 
+#define _GNU_SOURCE // strnlen
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -10,14 +11,34 @@
 #include <linux/spi/spidev.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
 #include <bcm2835.h>
 #include "ili9341_spi.h"
+#include "log_reader.h"
+#include "checkpoint.h"
+#include "pyramid.h"
+#include "history.h"
+#include "minmax.h"
+#include "series.h"
+#include "mailbox.h"
+#include "widgets.h"
+#include "sample_proto.h"
+#include "latency.h"
+#include "tiles.h"
+#include "sprite.h"
 
 #include <math.h>
-#include <sys/inotify.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <pthread.h>
 
 /*
 amount of time between each pixel on the x axis
@@ -38,15 +59,33 @@ the timestamp (0 - 60) by this value
 #define CS2_HIGH() bcm2835_gpio_write(cs2_pin, HIGH)
 
 #define DATA_INTERVAL_MINUTES 15 
+#define LOG_INTERVAL_SECONDS 60 // time between two lines in LOG_FILE
 #define GRAPH_XAXIS_MARK_INTERVAL 12*60 // 12hours
 
 // read sensor data from this file
 #define LOG_FILE "/home/pi/driver_dev/SPI/BME280.log"
 #define GRAPH_BUF_LEN 300 // length of ring buffer for sensor values == length of x axis in pixels
+// every line of LOG_FILE starts with a timestamp like this, lines are sorted by it
+#define LOG_TIME_FORMAT "%Y-%m-%d %H:%M:%S"
+#define LOG_TIME_LEN 19 // of a formatted timestamp
 
-// inotify to watch LOG_FILE
-#define EVENT_SIZE  ( sizeof (struct inotify_event) )
-#define EVENT_BUF_LEN     ( 1024 * ( EVENT_SIZE + 16 ) )
+// ringbuffer and logfile position get saved here so restarts
+// only have to read what was appended to LOG_FILE in the meantime
+#define CHECKPOINT_FILE "/home/pi/driver_dev/SPI/weather_graph.ckpt"
+#define CHECKPOINT_VERSION 5
+#define CHECKPOINT_EVERY 4 // new ringbuffer entries between checkpoints
+
+// what goes where on the displays, see widgets.h
+// default_layout is used if there is no such file
+#define LAYOUT_FILE "/home/pi/driver_dev/SPI/weather_graph.layout"
+#define PAGE_SECONDS 10 // time a page stays on a panel with several pages
+
+// sample-to-glass latency histograms, rewritten after every traced frame
+#define STATS_FILE "/tmp/weather_graph.stats"
+
+// wait this long after the first change before parsing LOG_FILE,
+// so a burst of writes only leads to one parse and redraw
+#define DEBOUNCE_MS 200
 
 
 //static uint16_t width, height;
@@ -58,70 +97,179 @@ static uint8_t rst_pin = RPI_V2_GPIO_P1_18;
 static uint8_t cs2_pin = RPI_V2_GPIO_P1_16;
 static uint8_t cs_pin = RPI_V2_GPIO_P1_13;
 
-static int fd_inotify;
-static int wd_inotify;
-static uint64_t logfile_pos = 0;
-
-// ringbuffer for sensor values
-// one ringbuffer element stores sensor value for all three types
+static struct log_watch logwatch; // inotify on the directory of LOG_FILE
+static int fd_epoll;
+static int fd_timer;    // debounce timer, armed on the first change of a burst
+static int fd_signal;   // SIGINT/SIGTERM
+static int fd_page = -1; // page rotation, only if a panel has several pages
+static int fd_sample = -1; // samples pushed by sensor daemons, see sample_proto.h
+static uint8_t timer_armed = 0;
+static uint64_t t_log_event; // first change of the current debounce window
+static struct log_reader logreader; // keeps LOG_FILE open between updates
+
+// ringbuffer for sensor values, one array per channel (see series.h)
+// all sensor values in integers * 100 instead of floats
+// channels are in logfile order
 // NOTE: we don't store the timestamp from the logfile in the ringbuffer
-struct sensor_vals {
-    // all sensor values in integers * 100 instead of floats
-    uint16_t temp;
-    uint16_t hum;
-    uint32_t press;
-};
-static struct sensor_vals *values;
-static uint16_t rb_read_index = 0, rb_write_index = 0;
+#define CH_TEMP 0
+#define CH_PRESS 1
+#define CH_HUM 2
+#define NUM_CHANNELS 3
+static struct series_store values;
+
+// every sample of the logfile, downsampled to several resolutions
+// so graphs can show longer time spans than the ringbuffer
+static struct pyramid pyr;
+// every sample of the logfile, compressed, for raw views and the latest
+// values. weeks of samples in less memory than a day took uncompressed.
+// not part of the checkpoint, the newest samples get read back from the log
+#define HISTORY_BYTES (64 * 1024)
+static struct history hist;
+// raw samples a graph can show at most
+#define RAW_SECONDS ((int64_t)TFT_WIDTH * LOG_INTERVAL_SECONDS)
+static uint64_t samples_parsed = 0; // every sample, not just the ringbuffer ones
+static int64_t last_sample_time = -1; // samples from the log and the socket have to be newer
 
-// functions to retrieve sensor values from ringbuffer element
-uint32_t get_temp(uint16_t index)
-{
-    return values[index].temp;
-}
-uint32_t get_press(uint16_t index)
-{
-    return values[index].press;
-}
-uint32_t get_hum(uint16_t index)
-{
-    return values[index].hum;
-}
 // holds configuration values for function drawGraph
 struct graph_config
 {
     char type;
-    uint32_t min;       // draw y-axis from current minimum to maximum sensor value
-    uint32_t max;
-    uint32_t mark_big;  // big mark interval on y-axis
-    uint32_t mark_small;    // small mark interval on y-axis
-    uint32_t (*get_val_func)(uint16_t); // function pointer to either get T,P, or H sensor values
-                                        // from the ringbuffer
+    const char *name;   // referenced by data= in the layout
+    uint16_t width;     // of the graph widget showing it, 0 if there is none
+    int32_t min;        // draw y-axis from current minimum to maximum sensor value,
+    int32_t max;        // as of the last collect_graph (main thread only)
+    int32_t mark_big;   // big mark interval on y-axis
+    int32_t mark_small;     // small mark interval on y-axis
+    uint8_t view;       // 0: draw the ringbuffer, 1: the raw samples of hist,
+                        // n > 1: draw level n - 2 of pyr (2: 15min, 3: 1h ~12 days,
+                        // 4: 6h ~2.5 months, 5: 1day ~10 months)
+    uint8_t channel;    // channel to draw from values or pyr
+    enum pyramid_stat stat; // what to draw per bucket of pyr
+    // what the plot area shows right now, so updates only send the difference
+    uint16_t drawn_bar[TFT_WIDTH];  // bar height per column
+    uint16_t drawn_color[TFT_WIDTH];
+    int32_t drawn_min;  // y axis range the marks are drawn for
+    int32_t drawn_max;
+    struct minmax_window mm;    // min/max of the drawn part of the ringbuffer,
+                                // set up by drawGraph, updated by parse_line
 };
 static struct graph_config temp = {
     .type = 'T',
+    .name = "temp",
     .min = -1,
     .max = 0,
     .mark_big = 100,
     .mark_small = 50,
-    .get_val_func = &get_temp
+    .channel = CH_TEMP
 };   
 static struct graph_config pres = {
     .type = 'P',
+    .name = "pres",
     .min = -1,
     .max = 0,
     .mark_big = 100,
     .mark_small = 50,
-    .get_val_func = &get_press
+    .channel = CH_PRESS
 };   
 static struct graph_config hum = {
     .type = 'H',
+    .name = "hum",
     .min = -1,
     .max = 0,
     .mark_big = 500,
     .mark_small = 250,
-    .get_val_func = &get_hum
+    .channel = CH_HUM
 };   
+static struct graph_config *graphs[] = { &temp, &pres, &hum };
+#define NUM_GRAPHS (sizeof graphs / sizeof *graphs)
+
+// the sensor data drawGraph needs for one graph, collected on the ingestion
+// side so the render thread never touches values, pyr or the minmax windows
+struct graph_data
+{
+    int32_t vals[TFT_WIDTH];    // oldest first
+    int16_t no_data;            // leading columns without data
+    int16_t count;              // columns filled, vals[count..] are garbage
+    int32_t min;
+    int32_t max;
+};
+
+// everything screen_draw() needs, posted to the render thread
+struct frame
+{
+    struct graph_data data[NUM_GRAPHS]; // in the order of graphs[]
+    int32_t latest[NUM_CHANNELS];       // newest sample
+    uint8_t have_latest;
+    uint32_t page_tick;                 // page switches so far
+    // latency_now() when the samples of the frame came in, got parsed and
+    // the frame got posted. t_event is 0 for frames without new samples
+    uint64_t t_event, t_parsed, t_posted;
+};
+// newest frame not drawn yet, older ones get dropped if rendering lags behind
+static struct mailbox frames;
+static pthread_t render_thread;
+
+// channel names for data= of value widgets, same as the graph names
+static const char *channel_names[NUM_CHANNELS] = { "temp", "pres", "hum" };
+// view= of graph widgets, index is graph_config.view: the ringbuffer, the
+// raw samples, then the levels of pyr. spans at 280 pixels: 15min ~3 days,
+// 1h ~12 days (a week), 6h ~70 days (a month or two), 1d ~9 months
+static const char *view_names[2 + PYRAMID_LEVELS] = { "ring", "raw", "15min", "1h", "6h", "1d" };
+// x axis mark interval of every view in seconds, round numbers so the
+// marks get readable labels
+static const uint32_t view_marks[2 + PYRAMID_LEVELS] = {
+    GRAPH_XAXIS_MARK_INTERVAL * 60, 30 * 60, GRAPH_XAXIS_MARK_INTERVAL * 60,
+    2 * 24 * 3600, 7 * 24 * 3600, 30 * 24 * 3600
+};
+// stat= of graph widgets, in the order of enum pyramid_stat
+static const char *stat_names[] = { "avg", "min", "max" };
+
+static const char default_layout[] =
+    "panel name=left cs=0 bg=black\n"
+    "graph parent=left x=0 y=0 w=320 h=120 data=temp color=green\n"
+    "graph parent=left x=0 y=120 w=320 h=120 data=hum color=green\n"
+    "panel name=right cs=1 bg=black\n"
+    "graph parent=right x=0 y=0 w=320 h=240 data=pres color=green\n";
+static struct widget_tree layout;
+
+// page cache, for panels with several pages (indexed by widget)
+// hidden pages keep getting drawn into their buffer as data comes in,
+// switching only sends the pixels that differ from what is on screen
+static uint16_t *page_buf[WIDGETS_MAX];    // page: content while hidden
+static uint16_t *screen_buf[WIDGETS_MAX];  // panel: what is on the display
+static int8_t shown_page[WIDGETS_MAX];     // panel: page on the display
+static uint8_t num_pages[WIDGETS_MAX];     // panel
+
+// cursor widgets: an arrow sprite pointing left at the newest value of
+// the graph w->ref, moved by sprite_move() (indexed by widget)
+#define CURSOR_W 8
+#define CURSOR_H 7
+static struct sprite cursors[WIDGETS_MAX];
+static uint32_t page_tick = 0;
+
+// stages of an update, from the change of the log (or the datagram)
+// to the last byte on the panels. histograms belong to the render thread
+enum latency_stage {
+    LAT_PARSE,      // event -> parsed, includes the debounce window
+    LAT_COLLECT,    // parsed -> frame posted
+    LAT_QUEUE,      // posted -> picked up by the render thread
+    LAT_PANEL0,     // picked up -> last byte on the panel with cs=0
+    LAT_PANEL1,     // ... cs=1
+    LAT_TOTAL,      // event -> last byte on the last panel
+    LAT_STAGES
+};
+static struct latency_hist latency[LAT_STAGES] = {
+    [LAT_PARSE] = { .name = "parse" },
+    [LAT_COLLECT] = { .name = "collect" },
+    [LAT_QUEUE] = { .name = "queue" },
+    [LAT_PANEL0] = { .name = "panel0" },
+    [LAT_PANEL1] = { .name = "panel1" },
+    [LAT_TOTAL] = { .name = "total" },
+};
+// latency_now() after the last byte of a panel got sent by screen_draw(),
+// 0 if nothing was sent. spidev transfers are synchronous, so that is
+// when the bytes have left the bus
+static uint64_t panel_flushed[2];
 
 // have some fun with graph drawing
 // make a color gradient over the entire graph
@@ -181,109 +329,524 @@ uint16_t color_increase(uint16_t color)
     return color;
 }
 
+// color of plot column i, looked up from a table
+// that gets computed once instead of on every redraw
+uint16_t gradient_color(uint16_t i)
+{
+    static uint16_t lut[TFT_WIDTH];
+    static uint8_t lut_ready = 0;
+
+    if (!lut_ready)
+    {
+        // starting color for graph gradient, next one every 4 columns
+        uint16_t c = ILI9341_BLACK;
+        for (uint16_t k = 0; k < TFT_WIDTH; k++)
+        {
+            if (k % 4 == 0) c = color_increase(c);
+            lut[k] = c;
+        }
+        lut_ready = 1;
+    }
+    return lut[i];
+}
+
 /*
- * convert str to integer
- * used to read values from CSV logfile
- * implemented this for fun instead of using the standard atoi()
+ * read a value of the CSV logfile like "-13.25" as the integer -1325
+ * the decimal point is skipped, values in the log always have two decimals,
+ * so int32 can hold them. started out as a for-fun replacement of atoi(),
+ * now written so the loop has no branch besides the end of the field
  *
- * param:   takes pointer to pointer of string value in logfile line
+ * param:   s points to the value, end to the end of the line
  * returns: value as an integer
- *          and s now points to the next value in the source string
+ *          and s now points to the next value in the line
  */
-uint32_t str_to_int(char **s)
+static int32_t parse_fixed(const char **s, const char *end)
 {
+    const char *p = *s;
+    uint32_t neg = p < end && *p == '-';
     uint32_t res = 0;
-    char c;
-    
-    while ((c = *(*s)++) != ',' && c != '\n' && c != ':')
+
+    for (p += neg; p < end && *p != ',' && *p != '\n'; p++)
+    {
+        // '.' ends up > 9 and keeps res, a select instead of a branch
+        uint32_t d = (uint8_t)(*p - '0');
+        res = d < 10 ? res * 10 + d : res;
+    }
+    *s = p + (p < end);
+    return (res ^ -neg) + neg;
+}
+
+// days since 1970-01-01 of a date in the gregorian calendar
+static int64_t days_from_civil(int32_t y, uint32_t m, uint32_t d)
+{
+    y -= m <= 2;
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + doe - 719468;
+}
+
+/* timestamp at the start of a logfile line in seconds, -1 if it has none
+ * the format has fixed width, so every digit is at a known position
+ * and the check for garbage is or-ed together instead of tested one by one
+ */
+static int64_t parse_time(const char *s, size_t len)
+{
+    // offsets of the digits in LOG_TIME_FORMAT
+    static const uint8_t pos[14] = { 0, 1, 2, 3, 5, 6, 8, 9, 11, 12, 14, 15, 17, 18 };
+    uint32_t d[14], bad = 0;
+
+    if (len < LOG_TIME_LEN)
+        return -1;
+    for (uint8_t i = 0; i < 14; i++)
+    {
+        d[i] = (uint8_t)(s[pos[i]] - '0');
+        bad |= d[i] > 9;
+    }
+    bad |= (s[4] != '-') | (s[7] != '-') | (s[10] != ' ') | (s[13] != ':') | (s[16] != ':');
+
+    uint32_t year = d[0] * 1000 + d[1] * 100 + d[2] * 10 + d[3];
+    uint32_t mon = d[4] * 10 + d[5], day = d[6] * 10 + d[7];
+    uint32_t hour = d[8] * 10 + d[9], min = d[10] * 10 + d[11], sec = d[12] * 10 + d[13];
+    bad |= (mon - 1 > 11) | (day - 1 > 30) | (hour > 23) | (min > 59) | (sec > 60);
+    if (bad)
+        return -1;
+    return days_from_civil(year, mon, day) * 86400 + hour * 3600 + min * 60 + sec;
+}
+
+/* timestamp of a logfile line in seconds, -1 if it has none
+ * used to find the first line we need in the logfile at startup
+ */
+int64_t log_line_time(const char *line)
+{
+    return parse_time(line, strnlen(line, LOG_TIME_LEN));
+}
+
+// one line of the logfile
+struct log_record {
+    int64_t t;
+    uint8_t minute;
+    int32_t vals[NUM_CHANNELS];
+};
+
+/* parse a logfile line into a struct log_record
+ * called by the bulk reader from several threads at once
+ * returns 0 on success
+ */
+int parse_record(const char *line, size_t len, void *rec)
+{
+    struct log_record *r = rec;
+    const char *s = line + LOG_TIME_LEN + 1, *end = line + len;
+
+    r->t = parse_time(line, len);
+    if (r->t < 0 || len <= LOG_TIME_LEN + 1 || line[LOG_TIME_LEN] != ',')
     {
-        // read in float value as integer by ignoring decimal point
-        // used only on float strings with two decimal places (i.e. 13.xy),
-        // so int32 can hold the value
-        if (c == '.') continue;  
-        // convert ASCII char into digit and append to our integer value
-        res = res * 10 + (c & 0x0F);
+        fprintf(stderr, "malformed line: %.*s", (int)len, line);
+        return 1;
     }
-    return res;
+    r->minute = (line[14] - '0') * 10 + line[15] - '0';
+    for (uint8_t ch = 0; ch < NUM_CHANNELS; ch++)
+        r->vals[ch] = parse_fixed(&s, end);
+    return 0;
+}
+
+/* store a parsed line in the pyramid, and in the ringbuffer
+ * if its timestamp is one of the desired
+ */
+void add_record(const void *rec, void *arg)
+{
+    const struct log_record *r = rec;
+
+    // after a checkpoint got loaded hist is behind, see init_data_from_file()
+    if (r->t > history_last(&hist, NULL))
+        history_append(&hist, r->t, r->vals);
+
+    // already got it through the other path, or too late for the pyramid
+    if (r->t <= last_sample_time) return;
+    last_sample_time = r->t;
+
+    // every sample goes into the pyramid
+    pyramid_add(&pyr, r->t, r->vals);
+    samples_parsed++;
+
+    // only read values fitting our intervals from log file into the ringbuffer
+    if (r->minute % DATA_INTERVAL_MINUTES) return;
+
+    series_append(&values, r->vals);
+
+    // keep the sliding min/max of the graphs up to date
+    for (uint8_t i = 0; i < NUM_GRAPHS; i++)
+    {
+        if (graphs[i]->mm.window)
+            minmax_push(&graphs[i]->mm, r->vals[graphs[i]->channel]);
+    }
+}
+
+/* parse one line of the logfile and store it
+ * arg: non-NULL if new values should be printed
+ */
+void parse_line(char *line, size_t len, void *arg)
+{
+    struct log_record r;
+
+    if (parse_record(line, len, &r))
+        return;
+    // output new measured values
+    if (arg && !(r.minute % DATA_INTERVAL_MINUTES))
+        printf("read: %s\n", line);
+    add_record(&r, NULL);
+}
+
+// everything needed to continue where a previous run stopped
+struct checkpoint {
+    uint64_t logfile_pos;
+    uint64_t log_dev, log_ino;  // the logfile logfile_pos belongs to
+    uint16_t read_index, write_index;   // of values
+    int32_t min[NUM_GRAPHS], max[NUM_GRAPHS]; // of every graph_config
+    int32_t values[NUM_CHANNELS * GRAPH_BUF_LEN];
+    struct pyramid pyr;
+    int64_t last_sample_time;
+};
+static uint8_t samples_since_checkpoint = 0;
+
+void save_checkpoint()
+{
+    static struct checkpoint ck; // too big for the stack of a Pi Zero
+
+    ck.logfile_pos = logreader.pos;
+    ck.log_dev = logreader.dev;
+    ck.log_ino = logreader.ino;
+    ck.read_index = values.read_index;
+    ck.write_index = values.write_index;
+    for (uint8_t i = 0; i < NUM_GRAPHS; i++)
+    {
+        ck.min[i] = graphs[i]->min;
+        ck.max[i] = graphs[i]->max;
+    }
+    memcpy(ck.values, values.data, sizeof ck.values);
+    ck.pyr = pyr;
+    ck.last_sample_time = last_sample_time;
+
+    checkpoint_write(CHECKPOINT_FILE, CHECKPOINT_VERSION, &ck, sizeof ck);
+    samples_since_checkpoint = 0;
+}
+
+/* restore ringbuffer and logfile position from CHECKPOINT_FILE
+ * logreader has to be open already
+ * returns non-zero if there is no usable checkpoint for the current logfile
+ */
+int load_checkpoint()
+{
+    static struct checkpoint ck;
+    struct stat st;
+
+    if (checkpoint_read(CHECKPOINT_FILE, CHECKPOINT_VERSION, &ck, sizeof ck))
+        return 1;
+    if (ck.read_index >= GRAPH_BUF_LEN || ck.write_index >= GRAPH_BUF_LEN)
+    {
+        fprintf(stderr, "checkpoint is corrupt, ignoring it\n");
+        return 1;
+    }
+    // no logfile (yet): keep the samples, the log gets read from its start
+    // once it shows up and add_record() skips what is older than ours
+    if (logreader.fd < 0)
+    {
+        ck.logfile_pos = 0;
+    }
+    // logfile got rotated or truncated since the checkpoint was written
+    else if (ck.log_dev != logreader.dev || ck.log_ino != logreader.ino ||
+             fstat(logreader.fd, &st) || st.st_size < ck.logfile_pos)
+    {
+        fprintf(stderr, "checkpoint does not match %s, ignoring it\n", LOG_FILE);
+        return 1;
+    }
+
+    logreader.pos = ck.logfile_pos;
+    values.read_index = ck.read_index;
+    values.write_index = ck.write_index;
+    for (uint8_t i = 0; i < NUM_GRAPHS; i++)
+    {
+        graphs[i]->min = ck.min[i];
+        graphs[i]->max = ck.max[i];
+    }
+    memcpy(values.data, ck.values, sizeof ck.values);
+    pyr = ck.pyr;
+    last_sample_time = ck.last_sample_time;
+    return 0;
+}
+
+// seconds one x axis pixel of a graph stands for
+uint32_t seconds_per_pixel(struct graph_config *gc)
+{
+    if (!gc->view)
+        return DATA_INTERVAL_MINUTES * 60;
+    return gc->view > 1 ? pyramid_bucket_width(gc->view - 2) : LOG_INTERVAL_SECONDS;
+}
+
+// how far back in the logfile we have to read to fill every graph
+int64_t history_seconds()
+{
+    int64_t secs = (int64_t)GRAPH_BUF_LEN * DATA_INTERVAL_MINUTES * 60;
+
+    for (uint8_t i = 0; i < NUM_GRAPHS; i++)
+    {
+        int64_t span = graphs[i]->view > 1 ?
+            (int64_t)PYRAMID_LEN * seconds_per_pixel(graphs[i]) : RAW_SECONDS;
+        if (graphs[i]->view && span > secs)
+            secs = span;
+    }
+    return secs;
 }
 
 /* read stored data from a file at program start into ringbuffer
  * update ringbuffer with new data on subsequent calls
+ * the logfile stays open, later calls only read the appended bytes
  */
 int init_data_from_file()
 {
-    int16_t no_lines = 0;
-    FILE *f;
-    if (!(f = fopen(LOG_FILE, "r")))
+    if (!values.data)
+    {
+        // init ringbuffer and open logfile on first call of this function
+        if (series_init(&values, NUM_CHANNELS, GRAPH_BUF_LEN) ||
+            history_init(&hist, HISTORY_BYTES))
+        {
+            exit(1);
+        }
+        // without a logfile all samples have to come in through the socket
+        // until it gets created, the directory watch notices that
+        if (log_reader_open(&logreader, LOG_FILE, 0))
+        {
+            load_checkpoint();
+            return 0;
+        }
+
+        // continue after the last checkpoint, replaying only the newer lines.
+        // hist isn't in there, start early enough to get the samples a raw
+        // view shows back, add_record() only hands those to hist
+        // (samples that came in through the socket only are gone)
+        if (!load_checkpoint())
+        {
+            if (last_sample_time >= 0)
+            {
+                log_reader_seek(&logreader, log_line_time, last_sample_time - RAW_SECONDS);
+            }
+            return log_reader_bulk(&logreader, sizeof(struct log_record),
+                                   parse_record, add_record, NULL);
+        }
+
+        // only the last GRAPH_BUF_LEN intervals end up in the ringbuffer
+        // (or more if a graph shows a coarse pyramid level),
+        // bisect the logfile for the first of them instead of parsing
+        // everything from the start. costs O(log(filesize)) reads
+        int64_t last = log_reader_last_key(&logreader, log_line_time);
+        if (last >= 0)
+        {
+            log_reader_seek(&logreader, log_line_time, last - history_seconds());
+        }
+        // backfill on every core, the log is sorted so the records
+        // arrive in timestamp order
+        return log_reader_bulk(&logreader, sizeof(struct log_record),
+                               parse_record, add_record, NULL);
+    }
+
+    return log_reader_poll(&logreader, parse_line, &logreader);
+}
+
+
+/* scale values to column heights in pixels, 0 .. max_h
+ * one integer pass with a fixed point reciprocal (16 fractional bits)
+ * computed once, no floats and no branches per column.
+ * rounds like the float version did: up only if the height is within
+ * 0.05 pixel of the next integer (may differ by one pixel right at
+ * that threshold)
+ */
+#define HEIGHT_FRAC_BITS 16
+void column_heights(const int32_t *vals, uint16_t n, int32_t val_min,
+                    uint32_t val_range, uint16_t max_h, uint16_t *heights)
+{
+    // flat graph if all values are the same
+    uint32_t scale = val_range ?
+        (((uint32_t)max_h << HEIGHT_FRAC_BITS) + val_range / 2) / val_range : 0;
+    // (vals[i] - val_min) * scale <= (max_h << HEIGHT_FRAC_BITS) + val_range / 2,
+    // fits in 32bit
+    const uint32_t bias = (1 << HEIGHT_FRAC_BITS) / 20;
+
+    for (uint16_t i = 0; i < n; i++)
     {
-        perror("error");
-        exit(1);
+        heights[i] = ((uint32_t)(vals[i] - val_min) * scale + bias) >> HEIGHT_FRAC_BITS;
     }
+}
 
-    // TODO: intelligent searching for the first relevant datum
-    // read every line from the start of the file, if timestamp
-    // is one of the desired, save the date in ringbuffer
-        
-    if (logfile_pos == 0)
+/* bring one plot column from what drawn_bar/drawn_color say it shows
+ * to a bar of height bar and color
+ * grown: draw only the new part, shrunk: blacken only the removed part
+ * the whole bar is only redrawn if its color changed
+ */
+void update_column(struct graph_config *gc, uint16_t col, uint16_t x, uint16_t y,
+                   uint16_t bar, uint16_t color)
+{
+    uint16_t old = gc->drawn_bar[col];
+
+    if (bar && gc->drawn_color[col] != color)
     {
-        // init ringbuffer head on first call of this function
-        values = (struct sensor_vals*) malloc(sizeof (struct sensor_vals) * GRAPH_BUF_LEN);
+        fillRect(x, y, 1, bar, color);
     }
-    else
+    else if (bar > old)
+    {
+        fillRect(x, y + old, 1, bar - old, color);
+    }
+    if (bar < old)
     {
-        // seek to proper position in file on subsequent calls to this function
-        fseek(f, logfile_pos--, SEEK_SET);
+        fillRect(x, y + bar, 1, old - bar, ILI9341_BLACK);
     }
 
-    char line[40];
-    struct sensor_vals *ptr = values;
-    while (fgets(line, sizeof line, f))
+    gc->drawn_bar[col] = bar;
+    gc->drawn_color[col] = color;
+}
+
+// what a fillRect() costs on top of its pixels, in bytes of pixel data:
+// the window is only 11 bytes, but every one of them is a write() of its
+// own (~80us on a Pi Zero, the time 50MHz SPI needs for ~500 bytes)
+#define WINDOW_COST 512
+
+// bytes update_column() would send to bring the plot to bars/colors
+uint32_t plot_update_cost(struct graph_config *gc, const uint16_t *bars,
+                          const uint16_t *colors, uint16_t n)
+{
+    uint32_t cost = 0;
+
+    for (uint16_t i = 0; i < n; i++)
     {
-        
-        char *sep = strchr(line, ':') + 1; // point sep to minute 
-        uint8_t minute = (uint8_t) str_to_int(&sep); // sep now points to seconds value
-        sep = strchr(sep, ',') + 1; // point sep to first sensor value
+        uint16_t old = gc->drawn_bar[i];
+        if (bars[i] && gc->drawn_color[i] != colors[i])
+            cost += WINDOW_COST + bars[i] * 2;
+        else if (bars[i] > old)
+            cost += WINDOW_COST + (bars[i] - old) * 2;
+        if (bars[i] < old)
+            cost += WINDOW_COST + (old - bars[i]) * 2;
+    }
+    return cost;
+}
 
-        // only read values fitting our intervals from log file
-        if (minute % DATA_INTERVAL_MINUTES) continue;
+// plot area as columns for drawColumns(): bar from the bottom, black above
+struct plot_columns {
+    const uint16_t *bars;
+    const uint16_t *colors;
+};
 
-        // output new measured values
-        if (logfile_pos != 0) printf("read: %s\n", line);
+void plot_column(uint16_t col, uint16_t *line, uint16_t height, void *arg)
+{
+    struct plot_columns *pc = arg;
+    uint16_t j = 0;
 
-        uint16_t temp = str_to_int(&sep);
-        uint32_t press = str_to_int(&sep);
-        uint16_t hum = str_to_int(&sep);
+    for (; j < pc->bars[col]; j++)
+        line[j] = pc->colors[col];
+    for (; j < height; j++)
+        line[j] = ILI9341_BLACK;
+}
 
-        // TODO: do proper interface for ringbuffer?
+// copy channel ch of the n newest samples of hist to out, oldest first
+// returns the number of samples copied, less than n if there aren't enough
+uint16_t read_raw(uint8_t ch, int32_t *out, uint16_t n)
+{
+    struct history_iter it;
+    int64_t t;
+    int32_t vals[NUM_CHANNELS];
+    uint16_t i = 0;
+
+    history_seek_newest(&hist, &it, n);
+    while (i < n && history_next(&it, &t, vals))
+        out[i++] = vals[ch];
+    return i;
+}
 
-        // rb_write_buffer points to oldest datum, gets overwritten
-        ptr = values + rb_write_index;
-        ptr->temp = temp;
-        ptr->hum = hum;
-        ptr->press = press;
+/*  collect what drawGraph needs to draw gc with the given width
+    runs on the ingestion side, see struct graph_data */
+void collect_graph(struct graph_config *gc, uint16_t width, struct graph_data *gd)
+{
+    // same plot width as in drawGraph (don't draw on the y axis)
+    int16_t pixel_number = width - width/9 - 1;
+
+    // fetch the values to draw, oldest first, as one contiguous array
+    // there may not be enough data yet, the first no_data columns
+    // are left empty then
+    int32_t *vals = gd->vals;
+    uint16_t n = gc->view > 1 ?
+        pyramid_read(&pyr, gc->view - 2, gc->channel, gc->stat, vals, pixel_number) :
+        gc->view ? read_raw(gc->channel, vals, pixel_number) :
+        series_copy_newest(&values, gc->channel, pixel_number, vals);
+    int16_t no_data = pixel_number - n;
+    memmove(vals + no_data, vals, n * sizeof *vals);
+
+    int32_t val_min = INT32_MAX;
+    int32_t val_max = INT32_MIN;
+    //printf("init: val_min: %u val_max: %u\n", val_min, val_max);
 
-        // advance rb_write_index to the now oldest datum
-        rb_write_index = ++rb_write_index % GRAPH_BUF_LEN;
-        
-        // if write_index has caught up to read_index cause buffer is full
-        // advance read index
-        if (rb_write_index == rb_read_index) 
+    if (!gc->view)
+    {
+        // ringbuffer: parse_line keeps min and max up to date,
+        // only (re)fill the window when the graph size changed
+        if (gc->mm.window != pixel_number)
         {
-            rb_read_index = ++rb_read_index % GRAPH_BUF_LEN;
+            minmax_init(&gc->mm, pixel_number);
+            for (int i = no_data; i < pixel_number; i++)
+            {
+                minmax_push(&gc->mm, vals[i]);
+            }
+        }
+        if (n)
+        {
+            val_min = minmax_min(&gc->mm);
+            val_max = minmax_max(&gc->mm);
         }
-        
     }
-        
-    // save current position so we can start reading logfile from here
-    // on the next screen update
-    logfile_pos = ftell(f);
-    fclose(f);
+    else for (int i = no_data; i < pixel_number; i++)
+    {
+        // find min and max of sensor value
+        int32_t val = vals[i];
+        if (val < val_min) 
+        {
+            val_min = val;
+        }
+        if (val > val_max)
+        {
+            val_max = val;
+        }
+    }
+
+    if (val_min > val_max)
+    {
+        val_min = val_max = 0; // no data at all
+    }
+    gd->no_data = no_data;
+    gd->count = pixel_number;
+    gd->min = gc->min = val_min;
+    gd->max = gc->max = val_max;
 }
 
+// snapshot of everything the layout shows
+void collect_frame(struct frame *f)
+{
+    for (uint8_t i = 0; i < NUM_GRAPHS; i++)
+    {
+        if (graphs[i]->width)
+            collect_graph(graphs[i], graphs[i]->width, &f->data[i]);
+        else
+            f->data[i].no_data = f->data[i].count = 0;  // not shown anywhere
+    }
+
+    f->page_tick = page_tick;
+    f->t_event = 0; // not traced unless the caller says otherwise
+
+    // every sample ends up in hist, the newest one is the latest
+    f->have_latest = history_last(&hist, f->latest) >= 0;
+}
 
 /* draw both axis and graph for one sensor value */
 void drawGraph(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
-               struct graph_config* gc, uint16_t color, uint8_t flag_update)
+               struct graph_config* gc, const struct graph_data *gd,
+               uint16_t color, uint8_t flag_update)
 {
     if ((x < 0 || x + width > TFT_WIDTH) ||
         (y < 0 || y + height > TFT_HEIGHT))
@@ -302,40 +865,18 @@ void drawGraph(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
 
     //printf("drawg: %u %u %u %u      %u %u %u %u\n", x,y,width,height,poo_x,poo_y,len_x,len_y);
 
-    uint32_t val_min;
-    uint32_t val_max;
+    int32_t val_min;
+    int32_t val_max;
     uint32_t val_range;
 
     // we have this many pixels to draw for the graph (don't draw on the y axis)
     int16_t pixel_number = len_x - 1;
 
-    // values[rb_write_index] is unused, last value is values[rb_write_index-1]
-    // calculate starting index in ringbuffer values
-    int16_t start_index = rb_write_index - pixel_number;
-    //start_index = start_index < 0 ? GRAPH_BUF_LEN + start_index : start_index;
-    if (start_index < 0)
-    {
-        start_index = GRAPH_BUF_LEN + start_index;
-    }
-    val_min = -1; // biggest unsigned int value
-    val_max = 0; // lowest unsigned int value
-    //printf("init: val_min: %u val_max: %u\n", val_min, val_max);
-
-    for (int i = 0; i < pixel_number; i++)
-    {
-        // find min and max of sensor value
-        uint32_t val = gc->get_val_func((start_index + i) % GRAPH_BUF_LEN);
-        if (val < val_min) 
-        {
-            val_min = val;
-        }
-        if (val > val_max)
-        {
-            val_max = val;
-        }
-    }
-
-    val_range = val_max - val_min;
+    const int32_t *vals = gd->vals;
+    int16_t no_data = gd->no_data;
+    val_min = gd->min;
+    val_max = gd->max;
+    val_range = (uint32_t)val_max - (uint32_t)val_min;
     //printf("max: %i min: %i\n", val_max, val_min);
     
     uint8_t flag_redraw_y = 0;
@@ -345,9 +886,10 @@ void drawGraph(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
     {
         // compare with old val_min and val_max values to see if we need to redraw 
         // the y axis
-        if (val_max != gc->max || val_min != gc->min)
+        if (val_max != gc->drawn_max || val_min != gc->drawn_min)
         {
             // blacken y axis marks
+            ili9341_trace_site("drawGraph y axis");
             fillRect(x, y, width/9, height, ILI9341_BLACK);//WHITE);
             flag_redraw_y = 1;
         }
@@ -355,6 +897,9 @@ void drawGraph(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
     else
     {
         // initial drawing of the graph, so draw everything
+        // screen_draw() blackened the screen, the plot area is empty now
+        memset(gc->drawn_bar, 0, sizeof gc->drawn_bar);
+        ili9341_trace_site("drawGraph x axis");
 
         // x axis
         fillRect(poo_x, poo_y, len_x, 1, color);//WHITE);
@@ -363,55 +908,67 @@ void drawGraph(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
 
         // draw x axis and markings
         //len_x - 1 = number of pixels above x axis (without poo_x cause that would be drawing over the y axis)
-        // draw mark every 6h: 6 * 60 / 15 = 24 pixel, counted from the very right
         // draw mark every 12h: 12 * 60 / 15 = 48 pixel, counted from the very right
-        uint16_t pixel_step = GRAPH_XAXIS_MARK_INTERVAL / DATA_INTERVAL_MINUTES;
+        // other views have their own interval, see view_marks
+        uint32_t mark_secs = view_marks[gc->view];
+        uint16_t pixel_step = mark_secs / seconds_per_pixel(gc);
 
         // draw x axis marks and annotations 
         for (int16_t k = 0; k <= len_x / pixel_step; k++ )
         {
-            fillRect(width - 1 - k * pixel_step, poo_y - 5, 1, 5, color);//WHITE);
+            fillRect(x + width - 1 - k * pixel_step, poo_y - 5, 1, 5, color);//WHITE);
             if (k)
             {
                 //drawChar(width - 1 - 2 - k*pixel_step, poo_y - 15, 'X', ILI9341_GREEN, ILI9341_BLACK, 1, 1);
 
-                char mark_str[8];
+                char mark_str[12];
                 //int8_t number = - k * GRAPH_XAXIS_MARK_INTERVAL / 60;
-                int8_t number = k * GRAPH_XAXIS_MARK_INTERVAL / 60;
+                // annotate marks with minutes, hours or days
+                uint32_t number = k * mark_secs;
                 //int16_t number = 8888;
-                sprintf(mark_str, "%d", number); 
+                if (mark_secs < 3600)
+                    sprintf(mark_str, "%um", number / 60);
+                else if (number / 3600 < 100)
+                    sprintf(mark_str, "%u", number / 3600);
+                else
+                    sprintf(mark_str, "%ud", number / (24 * 3600));
                 //float pixel_offset = strlen(mark_str) / 2;
                 
                 for (uint8_t m = 0; m < strlen(mark_str); m++)
                 {
-                    drawChar(width - k*pixel_step - (uint8_t)(strlen(mark_str) * 6 / 2) + m * 6, poo_y - 15, mark_str[m], color, ILI9341_BLACK, 1, 1);
+                    drawChar(x + width - k*pixel_step - (uint8_t)(strlen(mark_str) * 6 / 2) + m * 6, poo_y - 15, mark_str[m], color, ILI9341_BLACK, 1, 1);
                 }
             } else
             {
                 char mark_str[4] = "now";
                 for (uint8_t m = 0; m < strlen(mark_str); m++)
                 {
-                    drawChar(width - (uint8_t)(strlen(mark_str) * 6) + m * 6, poo_y - 15, mark_str[m], color, ILI9341_BLACK, 1, 1);
+                    drawChar(x + width - (uint8_t)(strlen(mark_str) * 6) + m * 6, poo_y - 15, mark_str[m], color, ILI9341_BLACK, 1, 1);
                 }
             }
         }
     }
 
-    gc->max = val_max;
-    gc->min = val_min;
+    gc->drawn_max = val_max;
+    gc->drawn_min = val_min;
 
     // draw marks on y axis
     if (!flag_update || flag_redraw_y)
     {
+        ili9341_trace_site("drawGraph y axis");
         // but not at the point of origin
         // complex because resizing depends on val_min & val_max!
-        uint16_t rest = gc->mark_small - (val_min % gc->mark_small);
-        uint8_t number_of_marks = (val_max - (val_min + rest)) / gc->mark_small + (val_min % gc->mark_small?1:0);
+        // below zero % rounds towards zero, the marks must not move with the sign
+        int32_t off = (val_min % gc->mark_small + gc->mark_small) % gc->mark_small;
+        uint16_t rest = gc->mark_small - off;
+        int32_t marks = val_max < val_min + rest ? 0 :
+                        (val_max - (val_min + rest)) / gc->mark_small + (off?1:0);
+        uint8_t number_of_marks = marks;
         for (uint8_t i = 0; i < number_of_marks; i++) 
         {
             uint16_t tmp = rest + i * gc->mark_small;
             float rel_mark_pos = (float)tmp / val_range;
-            uint32_t mark_val = val_min + rest + i * gc->mark_small;
+            int32_t mark_val = val_min + rest + i * gc->mark_small;
             //printf("mark val: %d\n", mark_val);
             
             // draw small or big mark
@@ -431,10 +988,17 @@ void drawGraph(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
                 char mark_str[10];
                 
                 // use own itoa()-like implementation instead of sprintf ;)
-                int8_t k;
-                for (k = 0; mark_val; mark_val /= 10, k++)
+                // digits from the right, the sign goes in front of them
+                uint32_t abs_val = mark_val < 0 ? -mark_val : mark_val;
+                int8_t k = 0;
+                do
                 {
-                    mark_str[k] = mark_val % 10 | 0x30;
+                    mark_str[k++] = abs_val % 10 | 0x30;
+                    abs_val /= 10;
+                } while (abs_val);
+                if (mark_val < 0)
+                {
+                    mark_str[k++] = '-';
                 }
                 int8_t j = 0;
                 for (k -=1; k >= 0; k--,j++)
@@ -450,21 +1014,24 @@ void drawGraph(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
 
     uint16_t prev_y = 0;
     
-    // starting color for graph gradient
-    uint16_t c = ILI9341_BLACK;
+    // there are len_y - 1 pixel above the x axis
+    uint16_t heights[TFT_WIDTH];
+    column_heights(vals + no_data, pixel_number - no_data, val_min, val_range,
+                   len_y - 1, heights + no_data);
+
+    // bar height and gradient color of every column
+    uint16_t bars[TFT_WIDTH], colors[TFT_WIDTH];
 
     for (int i = 0; i < pixel_number; i++)
     {
-        float rel_pos = (float) (gc->get_val_func((start_index + i) % GRAPH_BUF_LEN) - val_min) / 
-                                    val_range;
-        float tmp = rel_pos * (len_y - 1);  // there are len_y - 1 pixel above the x axis
-        uint16_t y = roundf(tmp*10.0f)/10.0f;
-
         // color gradient
-        if (i % 4 == 0) c = color_increase(c);
+        colors[i] = gradient_color(i);
 
-        // blacken current column
-        fillRect(i + poo_x + 1, poo_y + 1, 1, len_y - 1, ILI9341_BLACK);//WHITE);
+        // columns without data have no bar
+        uint16_t y = i < no_data ? 0 : heights[i];
+        // this is sufficient if we (and even better than smoothing) in area-graph-mode
+        // bar covers y - 1 pixels above the x axis
+        bars[i] = y ? y - 1 : 0;
 
         /*
          * if we decide to switch back to line only graphs, then use this to get
@@ -512,13 +1079,29 @@ void drawGraph(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
         }
         prev_y = y;
         */
-       
-        // this is sufficient if we (and even better than smoothing) in area-graph-mode
-        fillRect(i + poo_x + 1, poo_y + 1, 1, y - 1, c);//WHITE);
 
         //writePixel(i + poo_x + 1, y + poo_y, color);
 
     }
+
+    // full redraws and big changes: stream the whole plot area through one
+    // window, otherwise only send what changed column by column
+    ili9341_trace_site("drawGraph plot");
+    uint32_t stream_cost = WINDOW_COST + (uint32_t)pixel_number * (len_y - 1) * 2;
+    if (plot_update_cost(gc, bars, colors, pixel_number) > stream_cost)
+    {
+        struct plot_columns pc = { bars, colors };
+        drawColumns(poo_x + 1, poo_y + 1, pixel_number, len_y - 1, plot_column, &pc);
+        memcpy(gc->drawn_bar, bars, pixel_number * sizeof *bars);
+        memcpy(gc->drawn_color, colors, pixel_number * sizeof *colors);
+    }
+    else
+    {
+        for (int i = 0; i < pixel_number; i++)
+        {
+            update_column(gc, i, i + poo_x + 1, poo_y + 1, bars[i], colors[i]);
+        }
+    }
     
     // draw x axis again because very low values can be drawn onto the x axis
     // if the axis is a different color this becomes visible as a gap we don't want
@@ -547,102 +1130,738 @@ void init_displays()
     CS2_HIGH();
 }
 
-// init inotify for monitoring sensor logfile
-void init_inotify()
+// add fd to the epoll set, returns -1 on error
+int watch_fd(int fd)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    if (fd < 0 || epoll_ctl(fd_epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+// datagram socket sensor daemons can push samples to, see sample_proto.h
+int init_sample_socket()
+{
+    int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    // only our user may get into the directory, so nobody else can
+    // inject samples. someone may have put it there before us, check
+    struct stat st;
+    if (mkdir(SAMPLE_SOCKET_DIR, 0700) < 0 && errno != EEXIST)
+    {
+        perror(SAMPLE_SOCKET_DIR);
+        close(sock);
+        return -1;
+    }
+    if (lstat(SAMPLE_SOCKET_DIR, &st) < 0 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != getuid() || (st.st_mode & 077))
+    {
+        fprintf(stderr, "%s is not a private directory of ours, no sample socket\n",
+                SAMPLE_SOCKET_DIR);
+        close(sock);
+        return -1;
+    }
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, SAMPLE_SOCKET, sizeof addr.sun_path - 1);
+    unlink(SAMPLE_SOCKET);
+    if (bind(sock, (struct sockaddr*) &addr, sizeof addr) < 0)
+    {
+        perror("bind");
+        close(sock);
+        return -1;
+    }
+    chmod(SAMPLE_SOCKET, 0600);
+    return sock;
+}
+
+/*  set up everything the main loop waits for:
+    inotify on the directory of LOG_FILE, the sample socket, the debounce
+    timer and SIGINT/SIGTERM */
+int init_events()
 {
-    fd_inotify = inotify_init();
+    sigset_t mask;
 
-    if (fd_inotify < 0)
+    // signals get delivered through fd_signal instead of interrupting us
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
     {
-        perror("inotify_init");
+        perror("sigprocmask");
+        return -1;
     }
-    wd_inotify = inotify_add_watch(fd_inotify, LOG_FILE, IN_MODIFY);
+    fd_signal = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    fd_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    log_watch_open(&logwatch, LOG_FILE);
+    fd_sample = init_sample_socket();
+
+    fd_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (fd_epoll < 0)
+    {
+        perror("epoll_create1");
+        return -1;
+    }
+    // the sample socket is optional, the log still works without it
+    if (watch_fd(fd_signal) || watch_fd(fd_timer) || watch_fd(logwatch.fd) ||
+        (fd_sample >= 0 && watch_fd(fd_sample)))
+    {
+        return -1;
+    }
+
+    // rotate pages if there is any panel with more than one
+    for (uint8_t i = 0; i < layout.count; i++)
+    {
+        if (num_pages[i] > 1 && fd_page < 0)
+        {
+            struct itimerspec its = {
+                .it_interval = { PAGE_SECONDS, 0 },
+                .it_value = { PAGE_SECONDS, 0 },
+            };
+            fd_page = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (fd_page < 0 || timerfd_settime(fd_page, 0, &its, NULL) < 0 ||
+                watch_fd(fd_page))
+            {
+                perror("page timer");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// start the debounce window unless one is already running
+void arm_timer()
+{
+    struct itimerspec its = {
+        .it_value = { DEBOUNCE_MS / 1000, DEBOUNCE_MS % 1000 * 1000000 },
+    };
+
+    if (timer_armed)
+    {
+        return;
+    }
+    if (timerfd_settime(fd_timer, 0, &its, NULL) < 0)
+    {
+        perror("timerfd_settime");
+        return;
+    }
+    timer_armed = 1;
+    t_log_event = latency_now();
+}
+
+// load the layout and resolve what the widgets show
+void init_layout()
+{
+    if (widgets_load(&layout, LAYOUT_FILE) < 0)
+    {
+        printf("no usable %s, using the default layout\n", LAYOUT_FILE);
+        if (widgets_parse(&layout, default_layout) < 0)
+            exit(1);
+    }
+
+    for (uint8_t i = 0; i < layout.count; i++)
+    {
+        struct widget *w = &layout.w[i];
+        if (w->type == WIDGET_GRAPH)
+        {
+            for (uint8_t g = 0; g < NUM_GRAPHS; g++)
+            {
+                if (!strcmp(w->data, graphs[g]->name))
+                    w->ref = g;
+            }
+            // a graph keeps track of what it has drawn, it can only be shown once
+            if (w->ref < 0 || graphs[w->ref]->width)
+            {
+                fprintf(stderr, "layout: graph %s unknown or used twice\n", w->data);
+                exit(1);
+            }
+            graphs[w->ref]->width = w->w;
+
+            int8_t view = -1, stat = -1;
+            for (uint8_t v = 0; v < sizeof view_names / sizeof *view_names; v++)
+            {
+                if (!strcmp(w->view[0] ? w->view : "ring", view_names[v]))
+                    view = v;
+            }
+            for (uint8_t st = 0; st < sizeof stat_names / sizeof *stat_names; st++)
+            {
+                if (!strcmp(w->stat[0] ? w->stat : "avg", stat_names[st]))
+                    stat = st;
+            }
+            if (view < 0 || stat < 0)
+            {
+                fprintf(stderr, "layout: graph %s has an unknown view or stat\n", w->data);
+                exit(1);
+            }
+            graphs[w->ref]->view = view;
+            graphs[w->ref]->stat = stat;
+        }
+        else if (w->type == WIDGET_VALUE)
+        {
+            for (uint8_t ch = 0; ch < NUM_CHANNELS; ch++)
+            {
+                if (!strcmp(w->data, channel_names[ch]))
+                    w->ref = ch;
+            }
+            if (w->ref < 0)
+            {
+                fprintf(stderr, "layout: unknown value %s\n", w->data);
+                exit(1);
+            }
+        }
+        else if (w->type == WIDGET_CURSOR)
+        {
+            for (uint8_t g = 0; g < layout.count; g++)
+            {
+                if (layout.w[g].type == WIDGET_GRAPH && !strcmp(w->data, layout.w[g].data))
+                    w->ref = g;
+            }
+            if (w->ref < 0 || w->w < CURSOR_W || w->h < CURSOR_H)
+            {
+                fprintf(stderr, "layout: cursor %s needs a graph of %s and %ux%u pixels\n",
+                        w->name, w->data, CURSOR_W, CURSOR_H);
+                exit(1);
+            }
+            // tip in the middle of the left edge, anything but color is transparent
+            uint16_t key = ~w->color;
+            if (!(w->pixels = malloc(CURSOR_W * CURSOR_H * sizeof *w->pixels)))
+            {
+                perror("malloc");
+                exit(1);
+            }
+            for (uint8_t j = 0; j < CURSOR_H; j++)
+            {
+                for (uint8_t i = 0; i < CURSOR_W; i++)
+                    w->pixels[j * CURSOR_W + i] = i >= 2 * abs(j - CURSOR_H / 2) ? w->color : key;
+            }
+            if (sprite_init(&cursors[i], w->pixels, CURSOR_W, CURSOR_H, key) < 0)
+                exit(1);
+        }
+    }
+
+    // panels show their first page to begin with
+    for (uint8_t i = 0; i < layout.count; i++)
+    {
+        struct widget *w = &layout.w[i];
+        if (w->type == WIDGET_PANEL)
+            shown_page[i] = -1;
+        else if (w->type == WIDGET_PAGE && !num_pages[w->panel]++)
+            shown_page[w->panel] = i;
+    }
+    for (uint8_t i = 0; i < layout.count; i++)
+    {
+        struct widget *w = &layout.w[i];
+        if (num_pages[w->panel] < 2)
+            continue;   // nothing to switch between
+        if (w->type != WIDGET_PANEL && w->page < 0)
+        {
+            fprintf(stderr, "layout: panel %s has pages, put everything on one\n",
+                    layout.w[w->panel].name);
+            exit(1);
+        }
+        uint16_t **buf = w->type == WIDGET_PANEL ? &screen_buf[i] :
+                         w->type == WIDGET_PAGE ? &page_buf[i] : NULL;
+        if (buf && !(*buf = calloc(ILI9341_SHADOW_PIXELS, sizeof **buf)))
+        {
+            perror("calloc");
+            exit(1);
+        }
+    }
+    // sprites read back what is under them, their panel needs a shadow
+    for (uint8_t i = 0; i < layout.count; i++)
+    {
+        struct widget *w = &layout.w[i];
+        if (w->type == WIDGET_CURSOR && !screen_buf[w->panel] &&
+            !(screen_buf[w->panel] = calloc(ILI9341_SHADOW_PIXELS, sizeof *screen_buf[w->panel])))
+        {
+            perror("calloc");
+            exit(1);
+        }
+    }
+}
+
+// the page panel p should show at page switch number tick
+int8_t wanted_page(uint8_t p, uint32_t tick)
+{
+    uint8_t n = tick % num_pages[p];
+    for (uint8_t i = p; i < layout.count; i++)
+    {
+        if (layout.w[i].type == WIDGET_PAGE && layout.w[i].panel == p && !n--)
+            return i;
+    }
+    return shown_page[p];
+}
+
+// point the driver to where w has to be drawn: the display, or the
+// buffer of its page if that is hidden right now
+void select_target(const struct widget *w)
+{
+    if (!screen_buf[w->panel])
+        ili9341_shadow(NULL);   // no page cache or sprites on this panel
+    else if (w->page < 0 || w->page == shown_page[w->panel])
+        ili9341_shadow(screen_buf[w->panel]);
+    else
+        ili9341_offscreen(page_buf[w->page]);
+}
+
+// top of the cursor sprite of w in frame f, on the same scale as the bar
+// drawGraph() draws for the newest value, -1 if the graph has no data
+int16_t cursor_y(const struct widget *w, const struct frame *f)
+{
+    const struct widget *g = &layout.w[w->ref];
+    const struct graph_data *gd = &f->data[g->ref];
+    if (gd->no_data >= gd->count)
+        return -1;
+
+    uint16_t poo_y = g->y + g->h/8;
+    uint16_t len_y = g->h - g->h/8;
+    uint16_t height;
+    column_heights(&gd->vals[gd->count - 1], 1, gd->min,
+                   (uint32_t)gd->max - (uint32_t)gd->min, len_y - 1, &height);
+    // the bar ends at poo_y + height - 1, keep the arrow inside the strip
+    int16_t y = poo_y + (height ? height - 1 : 0) - CURSOR_H / 2;
+    if (y > w->y + w->h - CURSOR_H)
+        y = w->y + w->h - CURSOR_H;
+    if (y < w->y)
+        y = w->y;
+    return y;
+}
+
+// state of the data a widget shows in frame f, see widget_update()
+uint32_t widget_key(const struct widget *w, const struct frame *f)
+{
+    if (w->type == WIDGET_VALUE)
+        return f->have_latest ? (uint32_t)f->latest[w->ref] : 0xffffffff;
+    if (w->type == WIDGET_CURSOR)
+        return (uint32_t)cursor_y(w, f);
+    if (w->type != WIDGET_GRAPH)
+        return 0;   // static content
+
+    // FNV-1a over the visible part of the graph
+    const struct graph_data *gd = &f->data[w->ref];
+    uint32_t h = 2166136261u;
+    uint32_t words[] = { gd->no_data, gd->count, gd->min, gd->max };
+    for (uint8_t k = 0; k < 4; k++)
+        h = (h ^ words[k]) * 16777619u;
+    for (int16_t k = gd->no_data; k < gd->count; k++)
+        h = (h ^ gd->vals[k]) * 16777619u;
+    return h;
+}
+
+// draw str with drawChar(), returns its width in pixels
+uint16_t draw_text(int16_t x, int16_t y, const char *str, uint16_t color,
+                   uint16_t bg, uint8_t size)
+{
+    uint16_t len = strlen(str);
+    for (uint16_t m = 0; m < len; m++)
+    {
+        drawChar(x + m * 6 * size, y, str[m], color, bg, size, size);
+    }
+    return len * 6 * size;
+}
+
+/*  draw one widget, its panel is selected already
+    flag_update: the panel is not blank, a widget that wasn't drawn
+    before has to clear its area first */
+void draw_widget(struct widget *w, const struct frame *f, uint8_t flag_update)
+{
+    ili9341_trace_site(w->name[0] ? w->name : NULL);
+    if (!w->drawn && flag_update && w->type != WIDGET_BOX && w->type != WIDGET_PANEL &&
+        w->type != WIDGET_PAGE)
+    {
+        fillRect(w->x, w->y, w->w, w->h, w->bg);
+    }
+
+    switch (w->type)
+    {
+    case WIDGET_PANEL:
+    case WIDGET_PAGE:
+    case WIDGET_BOX:
+        if (!w->drawn)
+            fillRect(w->x, w->y, w->w, w->h, w->bg);
+        break;
+    case WIDGET_GRAPH:
+        drawGraph(w->x, w->y, w->w, w->h, graphs[w->ref], &f->data[w->ref],
+                  w->color, w->drawn);
+        break;
+    case WIDGET_LABEL:
+        draw_text(w->x, w->y, w->text, w->color, w->bg, w->size);
+        break;
+    case WIDGET_VALUE:
+    {
+        char str[WIDGET_TEXT_LEN + 16] = "--";
+        uint8_t decimals = w->decimals > 2 ? 2 : w->decimals;
+        uint16_t div = decimals == 2 ? 1 : decimals ? 10 : 100;
+        if (f->have_latest)
+        {
+            // values are stored * 100
+            int32_t v = f->latest[w->ref] / div;
+            if (decimals)
+                snprintf(str, sizeof str, "%s%d.%0*d%s", v < 0 ? "-" : "",
+                         abs(v) / (100 / div), (int)decimals, abs(v) % (100 / div), w->text);
+            else
+                snprintf(str, sizeof str, "%d%s", v, w->text);
+        }
+        // text is drawn opaque, only the part the old text covered
+        // beyond the new one needs clearing
+        uint16_t width = draw_text(w->x, w->y, str, w->color, w->bg, w->size);
+        if (w->drawn_w > width)
+            fillRect(w->x + width, w->y, w->drawn_w - width, 8 * w->size, w->bg);
+        w->drawn_w = width;
+        break;
+    }
+    case WIDGET_ICON:
+        drawRGBBitmap(w->x, w->y, w->w, w->h, w->pixels, w->w);
+        break;
+    case WIDGET_CURSOR:
+    {
+        // moving only sends the pixels that change, the strip around the
+        // arrow is left alone
+        struct sprite *s = &cursors[w - layout.w];
+        int16_t y = cursor_y(w, f);
+        if (!w->drawn)
+        {
+            fillRect(w->x, w->y, w->w, w->h, w->bg);
+            s->visible = 0;
+        }
+        if (y < 0)
+            sprite_hide(s);
+        else if (sprite_move(s, w->x, y) < 0)
+            fprintf(stderr, "cursor %s: no shadow to read back from\n", w->name);
+        break;
+    }
+    }
+}
+
+// chip select of the display a panel is on
+void panel_select(const struct widget *panel, uint8_t level)
+{
+    bcm2835_gpio_write(panel->cs ? cs2_pin : cs_pin, level);
+    if (level == LOW)
+        ili9341_trace_frame(panel->cs);
 }
 
 /*  our main drawing function
-    set up the screen layout here
-    flag_update: only redraw dynamic content */
-void screen_draw(uint8_t flag_update)
+    the screen layout comes from the widget tree (init_layout())
+    flag_update: only redraw widgets whose data changed since they were
+    drawn, otherwise redraw everything */
+void screen_draw(uint8_t flag_update, const struct frame *f)
 {
-    // start drawing on the displays
-    uint16_t fg_color = ILI9341_GREEN;
-    uint16_t bg_color = ILI9341_BLACK;
+    panel_flushed[0] = panel_flushed[1] = 0;
+    for (uint8_t i = 0; i < layout.count; i++)
+    {
+        struct widget *w = &layout.w[i];
+        if (!flag_update)
+        {
+            w->drawn = 0;
+            w->key = widget_key(w, f);
+            widget_invalidate(w);
+        }
+        else
+        {
+            widget_update(w, widget_key(w, f));
+        }
+    }
 
-    CS_LOW();
+    // redraw the dirty widgets, panel by panel
+    for (uint8_t p = 0; p < layout.count; p++)
+    {
+        struct widget *panel = &layout.w[p];
+        uint8_t selected = 0;
+        if (panel->type != WIDGET_PANEL)
+            continue;
+
+        // a full redraw gets recorded into tiles that go out once each,
+        // instead of the panel background first and every widget on top
+        if (!flag_update)
+        {
+            panel_select(panel, LOW);
+            selected = 1;
+            tiles_begin(ILI9341_TFTWIDTH, ILI9341_TFTHEIGHT, panel->bg);
+        }
+        for (uint8_t i = p; i < layout.count; i++)
+        {
+            struct widget *w = &layout.w[i];
+            if (w->panel != p || !w->dirty)
+                continue;
+            // sprites read back from the shadow, the tiles only get there
+            // in tiles_end()
+            if (!flag_update && w->type == WIDGET_CURSOR)
+                continue;
+            if (!selected)
+            {
+                panel_select(panel, LOW);
+                selected = 1;
+            }
+            select_target(w);
+            draw_widget(w, f, flag_update);
+            widget_drawn(w);
+        }
+        if (!flag_update)
+        {
+            // the page cache of the panel sees the tiles like any drawing
+            select_target(panel);
+            ili9341_trace_site("tiles");
+            tiles_end();
+            for (uint8_t i = p; i < layout.count; i++)
+            {
+                struct widget *w = &layout.w[i];
+                if (w->panel != p || w->type != WIDGET_CURSOR)
+                    continue;
+                select_target(w);
+                draw_widget(w, f, flag_update);
+                widget_drawn(w);
+            }
+        }
+
+        // time for another page, its buffer is up to date already
+        int8_t page = num_pages[p] > 1 ? wanted_page(p, f->page_tick) : shown_page[p];
+        if (page != shown_page[p])
+        {
+            if (!selected)
+            {
+                panel_select(panel, LOW);
+                selected = 1;
+            }
+            // keep what the old page looks like for when it comes back
+            memcpy(page_buf[shown_page[p]], screen_buf[p],
+                   ILI9341_SHADOW_PIXELS * sizeof *screen_buf[p]);
+            ili9341_shadow(screen_buf[p]);
+            ili9341_trace_site("page switch");
+            presentBuffer(page_buf[page]);
+            shown_page[p] = page;
+        }
+        ili9341_shadow(NULL);
+        if (selected)
+        {
+            panel_select(panel, HIGH);
+            panel_flushed[panel->cs ? 1 : 0] = latency_now();
+        }
+    }
+}
 
-    if (!flag_update)
+// show the next page on every panel that has several
+void next_page()
+{
+    uint64_t expirations;
+
+    if (read(fd_page, &expirations, sizeof expirations) < 0 && errno != EAGAIN)
     {
-        fillRect(0,0,TFT_WIDTH,TFT_HEIGHT, bg_color);
+        perror("read");
+        return;
     }
-    //drawGraph(0, 0, _width, _height);
-    /*
-    drawGraph(0, 0, _width, _height, 'H', ILI9341_BLUE);
-    drawGraph(0, 0, _width, _height, 'P', ILI9341_GREEN);
-    drawGraph(0, 0, _width, _height, 'T', ILI9341_RED);
-    */
-    /*
-    drawGraph(0, _height/2-1, _width/2, _height/2, 'H', ILI9341_BLUE);
-    drawGraph(_width/2-1, _height/2-1, _width/2, _height/2, 'P', ILI9341_GREEN);
-    drawGraph(0, 0, _width, _height/2-1, 'T', ILI9341_RED);
-    //drawGraph(0, 0, _width/2, _height/2-1, 'T', ILI9341_RED);
-    */
-   // drawGraph(0, _height/2-1, _width, _height/2, 'H', ILI9341_CYAN);//BLUE);
-    drawGraph(0, TFT_HEIGHT/2, TFT_WIDTH, TFT_HEIGHT/2, &hum, fg_color, flag_update);//CYAN);//GREEN);
-    drawGraph(0, 0, TFT_WIDTH, TFT_HEIGHT/2, &temp, fg_color, flag_update);//MAGENTA);//RED);
-    //drawGraph(0, _height/2-1, _width/2, _height/2);
+    page_tick++;
+    struct frame f;
+    collect_frame(&f);
+    mailbox_post(&frames, &f);
+}
 
-    CS_HIGH();
+/*  drain pending inotify events, a change only starts the debounce
+    timer, parsing and drawing happen once it expires. the log reader
+    notices a rotation on its own, a new log only needs another look */
+void handle_inotify()
+{
+    if (log_watch_read(&logwatch))
+    {
+        arm_timer();
+    }
+}
 
-    CS2_LOW();
-    //startWrite2();
-    if (!flag_update)
+/*  hand what came in since samples_parsed was parsed and values.write_index
+    was write_index to the render thread, checkpoint every few samples
+    t_event: when the samples arrived, for the latency stats */
+void publish(uint64_t parsed, uint16_t write_index, uint64_t t_event)
+{
+    if (samples_parsed != parsed)
     {
-        fillRect(0,0,TFT_WIDTH,TFT_HEIGHT, bg_color);
+        // hand the new data to the render thread, replaces a frame it
+        // didn't get to yet. only widgets whose data changed get redrawn
+        struct frame f;
+        f.t_parsed = latency_now();
+        collect_frame(&f);
+        f.t_event = t_event;
+        f.t_posted = latency_now();
+        mailbox_post(&frames, &f);
+    }
+    if (values.write_index != write_index)
+    {
+        // new relevant data came in
+        if (++samples_since_checkpoint >= CHECKPOINT_EVERY)
+        {
+            save_checkpoint();
+        }
     }
-    //drawGraph(0, _height/2-1, _width, _height/2, 'P', ILI9341_ORANGE);//BLUE);
-    drawGraph(0, 0, TFT_WIDTH, TFT_HEIGHT, &pres, fg_color, flag_update);//ORANGE);//BLUE);
-    CS2_HIGH();
-    //endWrite2();
 }
 
-/*  monitor data log file for changes,
-    read in the new dataset(s) and redraw graph
+/*  debounce window is over: read in the new dataset(s) and redraw graph
     if a new dataset of relevant time frame came in */
 void update()
 {
-    uint32_t length;
-    char buffer[EVENT_BUF_LEN];
-    uint32_t i = 0;
+    uint64_t expirations;
 
-    while ((length = read(fd_inotify, buffer, EVENT_BUF_LEN)) == EINTR)
+    if (read(fd_timer, &expirations, sizeof expirations) < 0 && errno != EAGAIN)
     {
         perror("read");
-    } 
+    }
+    timer_armed = 0;
+
+    uint16_t write_index = values.write_index;
+    uint64_t parsed = samples_parsed;
+    // read new data from file and redraw graph
+    init_data_from_file();
+    publish(parsed, write_index, t_log_event);
+}
+
+/*  samples pushed to the socket go into the ringbuffer right away,
+    no debouncing: the mailbox already merges bursts into one frame */
+void handle_samples()
+{
+    struct sample_record recs[SAMPLE_MAX_RECORDS];
+    uint16_t write_index = values.write_index;
+    uint64_t parsed = samples_parsed;
+    uint64_t t_event = latency_now();
+    ssize_t length;
 
-    // process the inotify event
-    while (i < length) 
-    {     
-        struct inotify_event *event = (struct inotify_event*) &buffer[i];
-        if (event->mask & IN_MODIFY) 
+    while ((length = recv(fd_sample, recs, sizeof recs, 0)) >= 0)
+    {
+        if (!length || length % sizeof *recs)
         {
-            /*
-            printf("File %s modified.\n", event->name);
-            printf("event len: %d\n", event->len);
-            */
-    
-            uint64_t tmp = rb_write_index;
-            // read new data from file and redraw graph
-            init_data_from_file();
-            if (rb_write_index != tmp)
+            fprintf(stderr, "sample datagram of %zd bytes, ignoring it\n", length);
+            continue;
+        }
+        for (size_t i = 0; i < length / sizeof *recs; i++)
+        {
+            if (recs[i].version != SAMPLE_VERSION)
             {
-                // new relevant data came in
-                screen_draw(1);
+                fprintf(stderr, "sample record version %u, ignoring it\n", recs[i].version);
+                continue;
             }
+            struct log_record r = {
+                .t = recs[i].time,
+                .minute = recs[i].time / 60 % 60,
+                .vals = { recs[i].vals[0], recs[i].vals[1], recs[i].vals[2] },
+            };
+            add_record(&r, NULL);
+        }
+    }
+    if (errno != EAGAIN && errno != EINTR)
+    {
+        perror("recv");
+    }
+    publish(parsed, write_index, t_event);
+}
+
+// returns 1 if we got asked to quit
+int handle_signal()
+{
+    struct signalfd_siginfo si;
+
+    while (read(fd_signal, &si, sizeof si) == sizeof si)
+    {
+        if (si.ssi_signo == SIGINT || si.ssi_signo == SIGTERM)
+        {
+            return 1;
         }
-        i += EVENT_SIZE + event->len;
+    }
+    return 0;
+}
+
+// replace STATS_FILE with the current histograms
+void write_stats()
+{
+    char tmp[256];
+    snprintf(tmp, sizeof tmp, "%s.tmp", STATS_FILE);
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+    {
+        perror(tmp);
+        return;
+    }
+    fprintf(f, "# sample-to-glass latency, %llu frames dropped\n",
+            (unsigned long long) mailbox_dropped(&frames));
+    latency_print(f, latency, LAT_STAGES);
+    if (fclose(f) || rename(tmp, STATS_FILE))
+    {
+        perror(STATS_FILE);
+        unlink(tmp);
     }
 }
 
+// account the stages of frame f, picked up from the mailbox at taken
+void trace_frame(const struct frame *f, uint64_t taken)
+{
+    uint64_t last = 0;
+
+    latency_add(&latency[LAT_PARSE], f->t_parsed - f->t_event);
+    latency_add(&latency[LAT_COLLECT], f->t_posted - f->t_parsed);
+    latency_add(&latency[LAT_QUEUE], taken - f->t_posted);
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        if (!panel_flushed[i])
+            continue;
+        latency_add(&latency[LAT_PANEL0 + i], panel_flushed[i] - taken);
+        if (panel_flushed[i] > last)
+            last = panel_flushed[i];
+    }
+    if (last)
+        latency_add(&latency[LAT_TOTAL], last - f->t_event);
+    write_stats();
+}
+
+// draw every frame posted to the mailbox until it gets closed
+void *render_main(void *arg)
+{
+    static struct frame f;
+
+    while (!mailbox_take(&frames, &f))
+    {
+        uint64_t taken = latency_now();
+        screen_draw(1, &f);
+        if (f.t_event)
+            trace_frame(&f, taken);
+    }
+    return NULL;
+}
+
+// undo everything main() set up
+void cleanup()
+{
+    log_watch_close(&logwatch);
+    close(fd_timer);
+    close(fd_signal);
+    close(fd_epoll);
+    if (fd_page >= 0)
+        close(fd_page);
+    if (fd_sample >= 0)
+    {
+        close(fd_sample);
+        unlink(SAMPLE_SOCKET);
+    }
+    log_reader_close(&logreader);
+
+    bcm2835_gpio_fsel(cs_pin, BCM2835_GPIO_FSEL_INPT);
+    bcm2835_gpio_fsel(cs2_pin, BCM2835_GPIO_FSEL_INPT);
+    ili9341_spi_close();
+    series_free(&values);
+    history_free(&hist);
+    mailbox_free(&frames);
+    for (uint8_t i = 0; i < WIDGETS_MAX; i++)
+    {
+        free(page_buf[i]);
+        free(screen_buf[i]);
+        if (i < layout.count && layout.w[i].type == WIDGET_CURSOR)
+            sprite_free(&cursors[i]);
+    }
+    widgets_free(&layout);
+}
+
 int main(int argc, char **argv)
 {
     char *name = argv[1];
@@ -665,26 +1884,70 @@ int main(int argc, char **argv)
 	bcm2835_gpio_write(cs_pin, HIGH);
 	bcm2835_gpio_write(cs2_pin, HIGH);
 
+    init_layout();
     // initialize sensor data
     init_data_from_file();
 
     init_displays();
 
-    screen_draw(0);
+    // first frame gets drawn right away, updates by the render thread
+    static struct frame f;
+    collect_frame(&f);
+    screen_draw(0, &f);
+    save_checkpoint();
 
-    init_inotify();
+    if (mailbox_init(&frames, sizeof (struct frame)) < 0)
+    {
+        return 1;
+    }
+    // thread inherits the signal mask, so start it after init_events()
+    if (init_events() < 0)
+    {
+        fprintf(stderr, "setting up the event loop failed\n");
+        cleanup();
+        return 1;
+    }
+    int err = pthread_create(&render_thread, NULL, render_main, NULL);
+    if (err)
+    {
+        fprintf(stderr, "starting the render thread: %s\n", strerror(err));
+        cleanup();
+        return 1;
+    }
     // redraw graph whenever new (relevant) data becomes available 
-    // in the sensor data log file
-    while (1)
+    // in the sensor data log file or gets pushed to the sample socket
+    uint8_t quit = 0;
+    while (!quit)
     {
-        update();
+        struct epoll_event events[4];
+        int n = epoll_wait(fd_epoll, events, 4, -1);
+        if (n < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.fd == fd_signal)
+                quit = handle_signal();
+            else if (events[i].data.fd == logwatch.fd)
+                handle_inotify();
+            else if (events[i].data.fd == fd_timer)
+                update();
+            else if (events[i].data.fd == fd_page)
+                next_page();
+            else if (events[i].data.fd == fd_sample)
+                handle_samples();
+        }
     }
-    
-    // this seems useless now ;)
-    // TODO implement cleanup function when program gets killed
-    inotify_rm_watch(fd_inotify, wd_inotify);
-    close(fd_inotify);
-    bcm2835_close();
-    free(values);
+
+    // let the render thread finish the frame it is drawing
+    mailbox_close(&frames);
+    pthread_join(render_thread, NULL);
+    printf("dropped frames: %llu\n", (unsigned long long) mailbox_dropped(&frames));
+
+    // keep what we have so the next start doesn't have to parse it again
+    save_checkpoint();
+    cleanup();
     return 0;
 }
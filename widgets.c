@@ -0,0 +1,297 @@
+/*  declarative widget tree, see widgets.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ili9341_spi.h"
+#include "widgets.h"
+
+static const char *type_names[] = { "panel", "box", "graph", "label", "value", "icon", "page",
+                                     "cursor" };
+
+static const struct {
+    const char *name;
+    uint16_t color;
+} colors[] = {
+    { "black", ILI9341_BLACK }, { "white", ILI9341_WHITE },
+    { "red", ILI9341_RED }, { "green", ILI9341_GREEN },
+    { "blue", ILI9341_BLUE }, { "cyan", ILI9341_CYAN },
+    { "magenta", ILI9341_MAGENTA }, { "yellow", ILI9341_YELLOW },
+    { "orange", ILI9341_ORANGE }, { "darkgrey", ILI9341_DARKGREY },
+    { "lightgrey", ILI9341_LIGHTGREY },
+};
+
+// color name or number like 0x07E0
+static uint16_t parse_color(const char *s)
+{
+    for (uint8_t i = 0; i < sizeof colors / sizeof *colors; i++)
+    {
+        if (!strcmp(s, colors[i].name))
+            return colors[i].color;
+    }
+    return strtol(s, NULL, 0);
+}
+
+// read w x h pixels of an icon
+static uint16_t *load_icon(const char *path, uint16_t w, uint16_t h)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        return NULL;
+    }
+    uint16_t *pixels = malloc((uint32_t)w * h * sizeof *pixels);
+    if (pixels && fread(pixels, sizeof *pixels, (uint32_t)w * h, f) != (uint32_t)w * h)
+    {
+        fprintf(stderr, "%s: expected %ux%u pixels\n", path, w, h);
+        free(pixels);
+        pixels = NULL;
+    }
+    fclose(f);
+    return pixels;
+}
+
+// parse one line of the layout into the next widget
+static int parse_line(struct widget_tree *t, char *line, int lineno)
+{
+    char *save, *tok = strtok_r(line, " \t", &save);
+    char file[128] = "";
+    uint8_t bg_set = 0;
+
+    if (!tok || *tok == '#')
+        return 0;   // empty line or comment
+    if (t->count == WIDGETS_MAX)
+    {
+        fprintf(stderr, "layout:%d: more than %d widgets\n", lineno, WIDGETS_MAX);
+        return -1;
+    }
+
+    struct widget *w = &t->w[t->count];
+    memset(w, 0, sizeof *w);
+    w->parent = -1;
+    w->ref = -1;
+    w->size = 1;
+    w->color = ILI9341_WHITE;
+    w->bg = ILI9341_BLACK;
+
+    uint8_t type;
+    for (type = 0; type < sizeof type_names / sizeof *type_names; type++)
+    {
+        if (!strcmp(tok, type_names[type]))
+            break;
+    }
+    if (type == sizeof type_names / sizeof *type_names)
+    {
+        fprintf(stderr, "layout:%d: unknown widget %s\n", lineno, tok);
+        return -1;
+    }
+    w->type = type;
+
+    while ((tok = strtok_r(NULL, " \t", &save)))
+    {
+        char *val = strchr(tok, '=');
+        if (!val)
+        {
+            fprintf(stderr, "layout:%d: expected key=value, got %s\n", lineno, tok);
+            return -1;
+        }
+        *val++ = '\0';
+
+        if (!strcmp(tok, "name"))
+            snprintf(w->name, sizeof w->name, "%s", val);
+        else if (!strcmp(tok, "parent"))
+        {
+            w->parent = widgets_find(t, val);
+            if (w->parent < 0)
+            {
+                fprintf(stderr, "layout:%d: unknown parent %s\n", lineno, val);
+                return -1;
+            }
+        }
+        else if (!strcmp(tok, "cs"))
+            w->cs = atoi(val);
+        else if (!strcmp(tok, "x"))
+            w->x = atoi(val);
+        else if (!strcmp(tok, "y"))
+            w->y = atoi(val);
+        else if (!strcmp(tok, "w"))
+            w->w = atoi(val);
+        else if (!strcmp(tok, "h"))
+            w->h = atoi(val);
+        else if (!strcmp(tok, "color"))
+            w->color = parse_color(val);
+        else if (!strcmp(tok, "bg"))
+        {
+            w->bg = parse_color(val);
+            bg_set = 1;
+        }
+        else if (!strcmp(tok, "size"))
+            w->size = atoi(val);
+        else if (!strcmp(tok, "decimals"))
+            w->decimals = atoi(val);
+        else if (!strcmp(tok, "text"))
+            snprintf(w->text, sizeof w->text, "%s", val);
+        else if (!strcmp(tok, "data"))
+            snprintf(w->data, sizeof w->data, "%s", val);
+        else if (!strcmp(tok, "view"))
+            snprintf(w->view, sizeof w->view, "%s", val);
+        else if (!strcmp(tok, "stat"))
+            snprintf(w->stat, sizeof w->stat, "%s", val);
+        else if (!strcmp(tok, "file"))
+            snprintf(file, sizeof file, "%s", val);
+        else
+        {
+            fprintf(stderr, "layout:%d: unknown key %s\n", lineno, tok);
+            return -1;
+        }
+    }
+
+    if ((type == WIDGET_PANEL) != (w->parent < 0))
+    {
+        fprintf(stderr, "layout:%d: panels have no parent, everything else needs one\n",
+                lineno);
+        return -1;
+    }
+    if (type == WIDGET_PAGE && t->w[w->parent].type != WIDGET_PANEL)
+    {
+        fprintf(stderr, "layout:%d: pages have to be on a panel\n", lineno);
+        return -1;
+    }
+    if (type == WIDGET_PANEL)
+    {
+        w->panel = t->count;
+        w->page = -1;
+        w->x = w->y = 0;
+        w->w = ILI9341_TFTWIDTH;
+        w->h = ILI9341_TFTHEIGHT;
+    }
+    else
+    {
+        // children inherit the background and are placed inside the parent
+        const struct widget *p = &t->w[w->parent];
+        w->panel = p->panel;
+        w->page = type == WIDGET_PAGE ? t->count : p->page;
+        w->x += p->x;
+        w->y += p->y;
+        if (type == WIDGET_PAGE)
+        {
+            w->w = p->w;
+            w->h = p->h;
+        }
+        if (!bg_set)
+            w->bg = p->bg;
+    }
+    if (type == WIDGET_LABEL || type == WIDGET_VALUE)
+    {
+        // text widgets are as big as their text unless told otherwise,
+        // values get room for 8 characters in front of the unit
+        if (!w->h)
+            w->h = 8 * w->size;
+        if (!w->w)
+            w->w = (strlen(w->text) + (type == WIDGET_VALUE ? 8 : 0)) * 6 * w->size;
+    }
+    if (w->x < 0 || w->y < 0 ||
+        w->x + w->w > ILI9341_TFTWIDTH || w->y + w->h > ILI9341_TFTHEIGHT)
+    {
+        fprintf(stderr, "layout:%d: widget out of bounds\n", lineno);
+        return -1;
+    }
+    if (type == WIDGET_ICON && !(w->pixels = load_icon(file, w->w, w->h)))
+        return -1;
+
+    t->count++;
+    return 0;
+}
+
+int widgets_parse(struct widget_tree *t, const char *text)
+{
+    char line[256];
+    int lineno = 0;
+
+    t->count = 0;
+    while (*text)
+    {
+        size_t len = strcspn(text, "\n");
+        lineno++;
+        if (len >= sizeof line)
+        {
+            fprintf(stderr, "layout:%d: line too long\n", lineno);
+            return -1;
+        }
+        memcpy(line, text, len);
+        line[len] = '\0';
+        text += len + (text[len] == '\n');
+        if (parse_line(t, line, lineno))
+        {
+            widgets_free(t);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int widgets_load(struct widget_tree *t, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+    char *text = malloc(size + 1);
+    if (!text || fread(text, 1, size, f) != (size_t)size)
+    {
+        free(text);
+        fclose(f);
+        return -1;
+    }
+    text[size] = '\0';
+    fclose(f);
+
+    int ret = widgets_parse(t, text);
+    free(text);
+    return ret;
+}
+
+int widgets_find(const struct widget_tree *t, const char *name)
+{
+    for (uint8_t i = 0; i < t->count; i++)
+    {
+        if (t->w[i].name[0] && !strcmp(t->w[i].name, name))
+            return i;
+    }
+    return -1;
+}
+
+// the widget's data is now in state key, marks it dirty if that changed
+void widget_update(struct widget *w, uint32_t key)
+{
+    if (w->drawn && w->key == key)
+        return;
+    w->key = key;
+    widget_invalidate(w);
+}
+
+void widget_invalidate(struct widget *w)
+{
+    w->dirty = 1;
+}
+
+void widget_drawn(struct widget *w)
+{
+    w->dirty = 0;
+    w->drawn = 1;
+}
+
+void widgets_free(struct widget_tree *t)
+{
+    for (uint8_t i = 0; i < t->count; i++)
+    {
+        free(t->w[i].pixels);
+        t->w[i].pixels = NULL;
+    }
+    t->count = 0;
+}
@@ -0,0 +1,99 @@
+/*  declarative widget tree
+ *
+ *  a layout file describes the screen as a tree of widgets, one per line:
+ *
+ *      # comment
+ *      panel name=left cs=0 bg=black
+ *      graph parent=left x=0 y=120 w=320 h=120 data=hum color=green
+ *      graph parent=right x=0 y=0 w=320 h=240 data=temp view=1h stat=max
+ *      value parent=left x=250 y=4 data=temp decimals=1 text=C size=2
+ *      label parent=left x=4 y=4 text=Temperature color=white
+ *      icon parent=left x=300 y=4 w=16 h=16 file=/path/to/sun.raw
+ *      cursor parent=right x=312 y=0 w=8 h=240 data=pres color=yellow
+ *
+ *  panel widgets are the roots, one per display. every other widget is
+ *  placed relative to its parent, which has to come first in the file.
+ *  a panel can hold several page widgets (page name=week parent=left),
+ *  the program shows one of them at a time. pages cover the whole panel,
+ *  a panel with pages should keep all its other widgets inside of them.
+ *  data= names what a widget shows, it is up to the program to resolve it,
+ *  just like view= (the time span of a graph) and stat= (what a graph
+ *  draws of each point in time, e.g. min, max or avg).
+ *  icon files hold w x h native RGB565 values, row-major.
+ *  a cursor is a strip next to the graph of the same data, a marker in it
+ *  points at the newest value. it should not overlap other widgets.
+ *
+ *  each widget keeps its own dirty state. the program hands the current
+ *  state of a widget's data to widget_update() (a value, a hash), which
+ *  only marks the widget dirty if it changed since the last draw, so a
+ *  flush only redraws the widgets whose data changed. how much of its box
+ *  a dirty widget sends is up to its drawing code (graphs only send the
+ *  columns that changed, values only the text).
+ */
+
+#ifndef WIDGETS_H
+#define WIDGETS_H
+
+#include <stdint.h>
+
+#define WIDGETS_MAX 32
+#define WIDGET_NAME_LEN 16
+#define WIDGET_TEXT_LEN 32
+
+enum widget_type {
+    WIDGET_PANEL,
+    WIDGET_BOX,     // groups children, draws nothing but its background
+    WIDGET_GRAPH,
+    WIDGET_LABEL,
+    WIDGET_VALUE,
+    WIDGET_ICON,
+    WIDGET_PAGE,    // one of several screens of a panel
+    WIDGET_CURSOR,  // marker following the newest value of a graph
+};
+
+struct widget {
+    uint8_t type;
+    char name[WIDGET_NAME_LEN];
+    int8_t parent;          // index in the tree, -1 for panels
+    uint8_t panel;          // index of the panel widget this belongs to
+    int8_t page;            // index of the page widget this is on, -1 if none
+    uint8_t cs;             // panels: which display
+    int16_t x, y;           // absolute screen position, resolved on load
+    uint16_t w, h;
+    uint16_t color, bg;
+    uint8_t size;           // text size
+    uint8_t decimals;       // value widgets
+    char text[WIDGET_TEXT_LEN]; // label text, unit of a value
+    char data[WIDGET_NAME_LEN]; // what the widget shows
+    char view[WIDGET_NAME_LEN]; // graphs: time span, empty for the default
+    char stat[WIDGET_NAME_LEN]; // graphs: statistic per point in time
+    uint16_t *pixels;       // icon, cursor
+    int16_t ref;            // free for the program, e.g. resolved data
+
+    // dirty tracking
+    uint8_t dirty;
+    uint8_t drawn;          // has been drawn since the last full redraw
+    uint16_t drawn_w;       // width of the text drawn last
+    uint32_t key;           // state of the data it was last drawn with
+};
+
+struct widget_tree {
+    struct widget w[WIDGETS_MAX];
+    uint8_t count;
+};
+
+// parse a layout, returns 0 or -1 on a bad line (reported on stderr)
+int widgets_parse(struct widget_tree *t, const char *text);
+// parse a layout file
+int widgets_load(struct widget_tree *t, const char *path);
+// index of the widget called name, -1 if there is none
+int widgets_find(const struct widget_tree *t, const char *name);
+// the widget's data is now in state key, marks it dirty if that changed
+void widget_update(struct widget *w, uint32_t key);
+// whole widget has to be redrawn
+void widget_invalidate(struct widget *w);
+// widget got drawn, clears its dirty state
+void widget_drawn(struct widget *w);
+void widgets_free(struct widget_tree *t);
+
+#endif // WIDGETS_H